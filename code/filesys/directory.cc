@@ -7,13 +7,26 @@
 //	of each directory entry means that we have the restriction
 //	of a fixed maximum size for file names.
 //
-//	The constructor initializes an empty directory of a certain size;
-//	we use ReadFrom/WriteBack to fetch the contents of the directory
-//	from disk, and to write back any modifications back to disk.
+//	The entries are grouped into buckets, one per disk sector, and
+//	the directory is an extendible hash over the buckets.  A table
+//	of 2^globalDepth pointers, indexed by the low bits of a name's
+//	hash, says which bucket holds the name.  When a bucket fills up
+//	it is split in two on one more hash bit, and if the table has no
+//	bit left to tell the halves apart it first doubles.  Only the
+//	bucket that overflowed is touched, so adding a name never costs
+//	more than a few sectors, and a lookup always costs two: one
+//	table page and one bucket.
+//
+//	The directory file grows through OpenFile::WriteAt like any
+//	other file.  Pages are never given back to the disk: when the
+//	table doubles, the pages of the old table go on a free list for
+//	later buckets, and buckets are not merged when they empty out.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
+//	The constructor initializes an empty directory; we use
+//	FetchFrom/WriteBack to fetch the contents of the directory
+//	from disk, and to write back any modifications back to disk.
+//	Pages are only read when first needed, and only the pages that
+//	have changed are written back.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -24,6 +37,30 @@
 #include "filehdr.h"
 #include "directory.h"
 #include "filesys.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// HashName
+// 	Return the hash of a file name.  The directory indexes its table
+//	with the low bits, so the result is mixed (as in MurmurHash3's
+//	finalizer) to make every character reach every bit.
+//
+//	"name" -- the file name; only the first FileNameMaxLen characters
+//		count, as only those are stored
+//----------------------------------------------------------------------
+
+static unsigned int HashName(char *name) {
+    unsigned int hash = 5381;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+        hash = hash * 33 + (unsigned char)name[i];
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
 
 //----------------------------------------------------------------------
 // Directory::Directory
@@ -32,19 +69,32 @@
 //	is all we need, but otherwise, we need to call FetchFrom in order
 //	to initialize it from disk.
 //
-//	"size" is the number of entries in the directory
+//	An empty directory has 2^InitialDirDepth buckets, and takes
+//	InitialDirPages pages.
 //----------------------------------------------------------------------
 
-Directory::Directory(int size) {
-    table = new DirectoryEntry[size];
-
-    // MP4 mod tag
-    memset(table, 0, sizeof(DirectoryEntry) *
-                         size); // dummy operation to keep valgrind happy
-
-    tableSize = size;
-    for (int i = 0; i < tableSize; i++)
-        table[i].inUse = FALSE;
+Directory::Directory() {
+    ASSERT(sizeof(DirectoryBucket) <= SectorSize);
+    ASSERT(sizeof(DirectoryHeader) <= SectorSize);
+    maxPages = 0;
+    pages = NULL;
+    dirty = NULL;
+    file = NULL;
+
+    DirectoryHeader *hdr = (DirectoryHeader *)NewPage(0);
+    hdr->globalDepth = InitialDirDepth;
+    hdr->tableStart = 1;
+    hdr->numPages = 1 + NumTablePages(InitialDirDepth);
+    hdr->freePage = -1;
+    for (int p = hdr->tableStart; p < hdr->numPages; p++)
+        (void)NewPage(p);
+    for (int i = 0; i < (1 << InitialDirDepth); i++) {
+        int page = AllocPage();
+
+        Bucket(page)->localDepth = InitialDirDepth;
+        SetTableEntry(hdr->tableStart, i, page);
+    }
+    ASSERT(hdr->numPages == InitialDirPages);
 }
 
 //----------------------------------------------------------------------
@@ -52,43 +102,321 @@ Directory::Directory(int size) {
 // 	De-allocate directory data structure.
 //----------------------------------------------------------------------
 
-Directory::~Directory() { delete[] table; }
+Directory::~Directory() {
+    DropPages();
+    delete[] pages;
+    delete[] dirty;
+}
 
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Read the contents of the directory from disk.  Nothing is read
+//	yet; each page is read from "file" when it is first needed, so
+//	"file" must stay open while the directory is in use.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
 
 void Directory::FetchFrom(OpenFile *file) {
-    (void)file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    DropPages();
+    this->file = file;
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk.  Pages
+//	that were not changed are skipped; pages past the end of the
+//	file make the file grow.  A run of changed pages, such as a new
+//	directory or a split bucket and its table page, is written with
+//	one call, so it can go to disk as one multi-sector request.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
 
 void Directory::WriteBack(OpenFile *file) {
-    (void)file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    for (int p = 0; p < maxPages; p++) {
+        int run = 0;
+        char *buf;
+
+        while (p + run < maxPages && pages[p + run] != NULL && dirty[p + run])
+            run++;
+        if (run == 0)
+            continue;
+        if (run == 1) {
+            (void)file->WriteAt(pages[p], SectorSize, p * SectorSize);
+        } else {
+            buf = new char[run * SectorSize];
+            for (int i = 0; i < run; i++)
+                memcpy(buf + i * SectorSize, pages[p + i], SectorSize);
+            (void)file->WriteAt(buf, run * SectorSize, p * SectorSize);
+            delete[] buf;
+        }
+        for (int i = 0; i < run; i++)
+            dirty[p + i] = FALSE;
+        p += run - 1;
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::Page
+// 	Return page "p" of the directory, reading it from the directory
+//	file first if it is not in memory yet.  A page past the end of
+//	the file reads as zeroes.
+//----------------------------------------------------------------------
+
+char *Directory::Page(int p) {
+    ASSERT(p >= 0);
+    if (p >= maxPages) {
+        int newMax = (maxPages == 0) ? InitialDirPages : maxPages;
+        char **newPages;
+        bool *newDirty;
+
+        while (newMax <= p)
+            newMax *= 2;
+        newPages = new char *[newMax];
+        newDirty = new bool[newMax];
+        for (int i = 0; i < newMax; i++) {
+            newPages[i] = (i < maxPages) ? pages[i] : NULL;
+            newDirty[i] = (i < maxPages) ? dirty[i] : FALSE;
+        }
+        delete[] pages;
+        delete[] dirty;
+        pages = newPages;
+        dirty = newDirty;
+        maxPages = newMax;
+    }
+    if (pages[p] == NULL) {
+        pages[p] = new char[SectorSize];
+        memset(pages[p], 0, SectorSize);
+        if (file != NULL)
+            (void)file->ReadAt(pages[p], SectorSize, p * SectorSize);
+        dirty[p] = FALSE;
+    }
+    return pages[p];
+}
+
+//----------------------------------------------------------------------
+// Directory::NewPage
+// 	Return page "p" of the directory cleared to zeroes, and marked to
+//	be written back.  Used for pages whose old contents don't matter.
+//----------------------------------------------------------------------
+
+char *Directory::NewPage(int p) {
+    char *page = Page(p);
+
+    memset(page, 0, SectorSize);
+    MarkDirty(p);
+    return page;
+}
+
+//----------------------------------------------------------------------
+// Directory::DropPages
+// 	Throw away the in-core copy of every page, changed or not.
+//----------------------------------------------------------------------
+
+void Directory::DropPages() {
+    for (int p = 0; p < maxPages; p++) {
+        delete[] pages[p];
+        pages[p] = NULL;
+        dirty[p] = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::TableEntry
+// 	Return the page of the bucket that entry "index" of the pointer
+//	table points to.
+//----------------------------------------------------------------------
+
+int Directory::TableEntry(int index) {
+    int start = Header()->tableStart;
+
+    ASSERT(index >= 0 && index < (1 << Header()->globalDepth));
+    return ((int *)Page(start + index / DirPointersPerPage))
+        [index % DirPointersPerPage];
 }
 
 //----------------------------------------------------------------------
-// Directory::FindIndex
-// 	Look up file name in directory, and return its location in the table of
-//	directory entries.  Return -1 if the name isn't in the directory.
+// Directory::SetTableEntry
+// 	Point entry "index" of the pointer table that starts at page
+//	"start" at the bucket in page "page".  The table is named by its
+//	first page, so that a doubling can fill in its new table before
+//	switching the header over to it.
+//----------------------------------------------------------------------
+
+void Directory::SetTableEntry(int start, int index, int page) {
+    int p = start + index / DirPointersPerPage;
+
+    ((int *)Page(p))[index % DirPointersPerPage] = page;
+    MarkDirty(p);
+}
+
+//----------------------------------------------------------------------
+// Directory::AllocPage
+// 	Find a page for a new bucket, from the free list if there is
+//	anything on it, otherwise from the end of the file.  The page is
+//	returned cleared.
+//----------------------------------------------------------------------
+
+int Directory::AllocPage() {
+    DirectoryHeader *hdr = Header();
+    int p;
+
+    if (hdr->freePage != -1) {
+        p = hdr->freePage;
+        hdr->freePage = *(int *)Page(p);
+    } else {
+        p = hdr->numPages++;
+    }
+    MarkDirty(0);
+    (void)NewPage(p);
+    return p;
+}
+
+//----------------------------------------------------------------------
+// Directory::FreePage
+// 	Put page "p" on the free list.  The first word of a free page
+//	links to the next one.
+//----------------------------------------------------------------------
+
+void Directory::FreePage(int p) {
+    DirectoryHeader *hdr = Header();
+
+    *(int *)NewPage(p) = hdr->freePage;
+    hdr->freePage = p;
+    MarkDirty(0);
+}
+
+//----------------------------------------------------------------------
+// Directory::DoubleTable
+// 	Double the pointer table, using one more bit of each name's hash
+//	to index it.  Entry i and entry i + 2^globalDepth of the new table
+//	both point where entry i of the old one did, so no name moves.
+//
+//	A table that still fits in its pages doubles in place; otherwise
+//	the new table goes at the end of the file (it has to be
+//	contiguous), and the old one's pages are freed.
+//
+//	Return FALSE if the table has already reached MaxDirDepth.
+//----------------------------------------------------------------------
+
+bool Directory::DoubleTable() {
+    DirectoryHeader *hdr = Header();
+    int oldSize = 1 << hdr->globalDepth;
+    int oldStart = hdr->tableStart;
+    int oldPages = NumTablePages(hdr->globalDepth);
+    int newPages = NumTablePages(hdr->globalDepth + 1);
+    int newStart = oldStart;
+
+    if (hdr->globalDepth == MaxDirDepth)
+        return FALSE;
+    if (newPages > oldPages) {
+        newStart = hdr->numPages;
+        hdr->numPages += newPages;
+        for (int p = newStart; p < newStart + newPages; p++)
+            (void)NewPage(p);
+    }
+    for (int i = 0; i < oldSize; i++) {
+        int page = TableEntry(i);
+
+        SetTableEntry(newStart, i, page);
+        SetTableEntry(newStart, i + oldSize, page);
+    }
+    if (newStart != oldStart) {
+        for (int p = oldStart; p < oldStart + oldPages; p++)
+            FreePage(p);
+        hdr->tableStart = newStart;
+    }
+    hdr->globalDepth++;
+    MarkDirty(0);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::Split
+// 	Split the bucket that entry "index" of the pointer table points
+//	to.  The names in it whose next hash bit is set move to a new
+//	bucket, and so do the table entries with that bit set.
+//
+//	Return FALSE if the bucket can't be split, because the table
+//	would have to grow past MaxDirDepth.
+//
+//	"index" -- a table entry pointing to the bucket
+//----------------------------------------------------------------------
+
+bool Directory::Split(int index) {
+    int page = TableEntry(index);
+    int depth = Bucket(page)->localDepth;
+
+    if (depth == Header()->globalDepth && !DoubleTable())
+        return FALSE;
+
+    int newPage = AllocPage();
+    DirectoryBucket *bucket = Bucket(page);
+    DirectoryBucket *sibling = Bucket(newPage);
+    int moved = 0;
+
+    bucket->localDepth = sibling->localDepth = depth + 1;
+    for (int i = 0; i < DirEntriesPerBucket; i++)
+        if (bucket->entry[i].inUse &&
+            (HashName(bucket->entry[i].name) >> depth) & 1) {
+            sibling->entry[moved++] = bucket->entry[i];
+            bucket->entry[i].inUse = FALSE;
+        }
+    MarkDirty(page);
+
+    // the table entries for the bucket are those agreeing with "index"
+    // on the low "depth" bits; the ones with the next bit set move
+    for (int i = (index & ((1 << depth) - 1)) | (1 << depth);
+         i < (1 << Header()->globalDepth); i += 1 << (depth + 1))
+        SetTableEntry(Header()->tableStart, i, newPage);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::Slot
+// 	Return entry slot "i" of the directory, where slots are numbered
+//	bucket by bucket, in pointer table order.  Used to walk through
+//	every entry.
+//
+//	Several table entries can point to the same bucket; only the
+//	first of them (the one below 2^localDepth) gives its slots.  The
+//	slots of the others are NULL, so that no entry is seen twice.
+//----------------------------------------------------------------------
+
+DirectoryEntry *Directory::Slot(int i) {
+    ASSERT(i >= 0 && i < NumSlots());
+    int index = i / DirEntriesPerBucket;
+    DirectoryBucket *bucket = Bucket(TableEntry(index));
+
+    if (index >= (1 << bucket->localDepth))
+        return NULL;
+    return &bucket->entry[i % DirEntriesPerBucket];
+}
+
+//----------------------------------------------------------------------
+// Directory::FindEntry
+// 	Look up file name in directory, and return its entry.  Return
+//	NULL if the name isn't in the directory.
 //
 //	"name" -- the file name to look up
+//	"page" -- if not NULL, set to the page of the bucket holding
+//		the entry
 //----------------------------------------------------------------------
 
-int Directory::FindIndex(char *name) {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
-            return i;
-    return -1; // name not in directory
+DirectoryEntry *Directory::FindEntry(char *name, int *page) {
+    int index = HashName(name) & ((1 << Header()->globalDepth) - 1);
+    int p = TableEntry(index);
+    DirectoryBucket *bucket = Bucket(p);
+
+    for (int i = 0; i < DirEntriesPerBucket; i++)
+        if (bucket->entry[i].inUse &&
+            !strncmp(bucket->entry[i].name, name, FileNameMaxLen)) {
+            if (page != NULL)
+                *page = p;
+            return &bucket->entry[i];
+        }
+    return NULL; // name not in directory
 }
 
 //----------------------------------------------------------------------
@@ -101,10 +429,10 @@ int Directory::FindIndex(char *name) {
 //----------------------------------------------------------------------
 
 int Directory::Find(char *name) {
-    int i = FindIndex(name);
+    DirectoryEntry *entry = FindEntry(name, NULL);
 
-    if (i != -1)
-        return table[i].sector;
+    if (entry != NULL)
+        return entry->sector;
     return -1;
 }
 
@@ -112,42 +440,42 @@ int Directory::Find(char *name) {
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
 //	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	the name's bucket is full and can no longer be split.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
 //----------------------------------------------------------------------
 
 bool Directory::Add(char *name, int newSector) {
-    if (FindIndex(name) != -1)
-        return FALSE;
-
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse) {
-            table[i].isDir = FALSE; /* MP4 */
-            table[i].inUse = TRUE;
-            strncpy(table[i].name, name, FileNameMaxLen);
-            table[i].sector = newSector;
-            return TRUE;
-        }
-    return FALSE; // no space.  Fix when we have extensible files.
+    return Add(name, newSector, FALSE);
 }
 
 /* MP4 */
 bool Directory::Add(char *name, int newSector, bool isDir){
-    if (FindIndex(name) != -1)
+    unsigned int hash = HashName(name);
+
+    if (FindEntry(name, NULL) != NULL)
         return FALSE;
 
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse) {
-            table[i].isDir = (isDir == TRUE)?TRUE: FALSE;
-            table[i].inUse = TRUE;
-            strncpy(table[i].name, name, FileNameMaxLen);
-            table[i].sector = newSector;
-            return TRUE;
-        }
-    return FALSE; // no space.  Fix when we have extensible files. 
+    for (;;) {
+        int index = hash & ((1 << Header()->globalDepth) - 1);
+        int page = TableEntry(index);
+        DirectoryBucket *bucket = Bucket(page);
+
+        for (int i = 0; i < DirEntriesPerBucket; i++)
+            if (!bucket->entry[i].inUse) {
+                DirectoryEntry *entry = &bucket->entry[i];
+
+                entry->isDir = (isDir == TRUE)?TRUE: FALSE;
+                entry->inUse = TRUE;
+                strncpy(entry->name, name, FileNameMaxLen);
+                entry->sector = newSector;
+                MarkDirty(page);
+                return TRUE;
+            }
+        if (!Split(index))
+            return FALSE; // no space, and the table can't grow
+    }
 }
 
 
@@ -160,33 +488,37 @@ bool Directory::Add(char *name, int newSector, bool isDir){
 //----------------------------------------------------------------------
 
 bool Directory::Remove(char *name) {
-    int i = FindIndex(name);
+    int page;
+    DirectoryEntry *entry = FindEntry(name, &page);
 
-    if (i == -1)
+    if (entry == NULL)
         return FALSE; // name not in directory
-    table[i].inUse = FALSE;
+    entry->inUse = FALSE;
+    MarkDirty(page);
     return TRUE;
 }
 
 
 //----------------------------------------------------------------------
 // Directory::List
-// 	List all the file names in the directory.
+// 	List all the file names in the directory, bucket by bucket.
 //----------------------------------------------------------------------
 
 void Directory::List(bool recursion, int depth) {
-    for(int i=0; i<tableSize; i++){
-        if(table[i].inUse == TRUE){
+    for(int i=0; i<NumSlots(); i++){
+        DirectoryEntry *entry = Slot(i);
+
+        if(entry != NULL && entry->inUse == TRUE){
             for(int j=0; j<depth; j++)
                 cout << "\t";
             
-            cout << "[" << i << "] " << table[i].name << " ";
-            if(table[i].isDir){
+            cout << "[" << i << "] " << entry->name << " ";
+            if(entry->isDir){
                 cout << "D\n";
                 if(recursion){
                     // fetch subdirectory from disk
-                    Directory* subDir = new Directory(NumDirEntries);
-                    OpenFile* subDirFile = new OpenFile(table[i].sector);
+                    Directory* subDir = new Directory;
+                    OpenFile* subDirFile = new OpenFile(entry->sector);
                     subDir->FetchFrom(subDirFile);
                     
                     // recursion list directory
@@ -212,18 +544,209 @@ void Directory::Print() {
     FileHeader *hdr = new FileHeader;
 
     printf("Directory contents:\n");
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse) {
-            printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
-            hdr->FetchFrom(table[i].sector);
+    for (int i = 0; i < NumSlots(); i++) {
+        DirectoryEntry *entry = Slot(i);
+
+        if (entry != NULL && entry->inUse) {
+            printf("Name: %s, Sector: %d\n", entry->name, entry->sector);
+            hdr->FetchFrom(entry->sector);
             hdr->Print();
         }
+    }
     printf("\n");
     delete hdr;
 }
 
 /* MP4 */
 bool Directory::IsDir(char* name){
-    int index = FindIndex(name);
-    return table[index].isDir;
+    DirectoryEntry *entry = FindEntry(name, NULL);
+    return entry != NULL && entry->isDir;
+}
+
+//----------------------------------------------------------------------
+// NameCache::NameCache
+// 	Initialize an empty cache with room for "size" lookups.  All the
+//	entries start out unused, chained together in LRU order.
+//----------------------------------------------------------------------
+
+NameCache::NameCache(int size) {
+    this->size = size;
+    entries = new NameCacheEntry[size];
+    hashTable = new int[size];
+    for (int e = 0; e < size; e++) {
+        entries[e].dirSector = -1;
+        entries[e].prev = e - 1;
+        entries[e].next = (e + 1 < size) ? e + 1 : -1;
+        entries[e].hashNext = -1;
+        hashTable[e] = -1;
+    }
+    lruHead = 0;
+    lruTail = size - 1;
+    lock = new Lock("name cache");
+}
+
+//----------------------------------------------------------------------
+// NameCache::~NameCache
+// 	De-allocate the cache.
+//----------------------------------------------------------------------
+
+NameCache::~NameCache() {
+    delete[] entries;
+    delete[] hashTable;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Hash
+// 	Return the hash chain for "name" in the directory whose header
+//	is at "dirSector".
+//----------------------------------------------------------------------
+
+int NameCache::Hash(int dirSector, char *name) {
+    return (HashName(name) + (unsigned int)dirSector * 31) % size;
+}
+
+//----------------------------------------------------------------------
+// NameCache::FindEntry
+// 	Return the entry for "name" in directory "dirSector", or -1 if
+//	the lookup isn't cached.
+//----------------------------------------------------------------------
+
+int NameCache::FindEntry(int dirSector, char *name) {
+    for (int e = hashTable[Hash(dirSector, name)]; e != -1;
+         e = entries[e].hashNext)
+        if (entries[e].dirSector == dirSector &&
+            !strncmp(entries[e].name, name, FileNameMaxLen))
+            return e;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Lookup
+// 	Look for a remembered answer to looking up "name" in directory
+//	"dirSector".  Return FALSE if there is none; otherwise return
+//	TRUE, with "sector" set to the name's header sector (-1 if the
+//	name isn't in the directory) and "isDir" to whether it is a
+//	directory.
+//----------------------------------------------------------------------
+
+bool NameCache::Lookup(int dirSector, char *name, int *sector, bool *isDir) {
+    int e;
+
+    lock->Acquire();
+    e = FindEntry(dirSector, name);
+    if (e != -1) {
+        *sector = entries[e].sector;
+        *isDir = entries[e].isDir;
+        Touch(e);
+    }
+    lock->Release();
+    return e != -1;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Enter
+// 	Remember the answer to looking up "name" in directory
+//	"dirSector", replacing any earlier one.  The least recently used
+//	entry makes room if the name is new.
+//
+//	"sector" -- the name's header sector, or -1 if it isn't there
+//	"isDir" -- is it a directory?
+//----------------------------------------------------------------------
+
+void NameCache::Enter(int dirSector, char *name, int sector, bool isDir) {
+    int e;
+
+    lock->Acquire();
+    e = FindEntry(dirSector, name);
+    if (e == -1) {
+        int h = Hash(dirSector, name);
+
+        e = lruTail;
+        if (entries[e].dirSector != -1)
+            HashRemove(e);
+        entries[e].dirSector = dirSector;
+        strncpy(entries[e].name, name, FileNameMaxLen);
+        entries[e].name[FileNameMaxLen] = '\0';
+        entries[e].hashNext = hashTable[h];
+        hashTable[h] = e;
+    }
+    entries[e].sector = sector;
+    entries[e].isDir = isDir;
+    Touch(e);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// NameCache::Purge
+// 	Forget every lookup in directory "dirSector".  Called when the
+//	directory is removed, as its header sector may come back as a
+//	different directory.  The freed entries are the first reused.
+//----------------------------------------------------------------------
+
+void NameCache::Purge(int dirSector) {
+    lock->Acquire();
+    for (int e = 0; e < size; e++)
+        if (entries[e].dirSector == dirSector) {
+            HashRemove(e);
+            entries[e].dirSector = -1;
+            Unlink(e);
+            entries[e].prev = lruTail;
+            entries[e].next = -1;
+            if (lruTail != -1)
+                entries[lruTail].next = e;
+            else
+                lruHead = e;
+            lruTail = e;
+        }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// NameCache::Touch
+// 	Move entry "e" to the most recently used end of the LRU list.
+//----------------------------------------------------------------------
+
+void NameCache::Touch(int e) {
+    if (e == lruHead)
+        return;
+    Unlink(e);
+    entries[e].prev = -1;
+    entries[e].next = lruHead;
+    if (lruHead != -1)
+        entries[lruHead].prev = e;
+    else
+        lruTail = e;
+    lruHead = e;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Unlink
+// 	Take entry "e" out of the LRU list.
+//----------------------------------------------------------------------
+
+void NameCache::Unlink(int e) {
+    if (entries[e].prev != -1)
+        entries[entries[e].prev].next = entries[e].next;
+    else
+        lruHead = entries[e].next;
+    if (entries[e].next != -1)
+        entries[entries[e].next].prev = entries[e].prev;
+    else
+        lruTail = entries[e].prev;
+}
+
+//----------------------------------------------------------------------
+// NameCache::HashRemove
+// 	Take entry "e" out of its hash chain.
+//----------------------------------------------------------------------
+
+void NameCache::HashRemove(int e) {
+    int *link = &hashTable[Hash(entries[e].dirSector, entries[e].name)];
+
+    while (*link != e) {
+        ASSERT(*link != -1);
+        link = &entries[*link].hashNext;
+    }
+    *link = entries[e].hashNext;
 }
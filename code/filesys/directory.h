@@ -18,6 +18,9 @@
 #define DIRECTORY_H
 
 #include "openfile.h"
+#include "disk.h"
+
+class Lock;
 
 #define FileNameMaxLen 9 // for simplicity, we assume
                          // file names are <= 9 characters long
@@ -39,21 +42,68 @@ class DirectoryEntry {
                                    // the trailing '\0'
 };
 
+// Number of entries in each bucket of a directory.  A bucket is stored
+// in one disk sector, along with its local depth.
+#define DirEntriesPerBucket \
+    ((int)((SectorSize - sizeof(int)) / sizeof(DirectoryEntry)))
+
+// The following class defines a bucket of directory entries.  Every name
+// in a bucket agrees on the low "localDepth" bits of its hash; those bits
+// are what the directory's pointer table used to send the name here.
+
+class DirectoryBucket {
+  public:
+    DirectoryEntry entry[DirEntriesPerBucket];
+    int localDepth; // # low hash bits shared by the names
+                    //   in this bucket
+};
+
+// The following class defines the first sector of a directory file,
+// which says where the rest of the directory is.  Pages are sector-sized
+// pieces of the directory file, numbered from 0.
+
+class DirectoryHeader {
+  public:
+    int globalDepth; // The pointer table has 2^globalDepth entries
+    int tableStart;  // First page of the pointer table
+    int numPages;    // # pages in the directory file
+    int freePage;    // First page on the free list, or -1
+};
+
+#define DirPointersPerPage ((int)(SectorSize / sizeof(int)))
+#define NumTablePages(depth) divRoundUp(1 << (depth), DirPointersPerPage)
+
+#define InitialDirDepth 2 // A new directory has 2^2 buckets
+#define MaxDirDepth 18    // The pointer table stops doubling at 2^18
+                          //   entries (a 1MB table); uneven hashing
+                          //   makes that enough for about 100,000
+                          //   names, not 2^18 full buckets
+
+// Size of the directory file of a newly created directory: the header
+// page, its pointer table, and one page per bucket.
+#define InitialDirPages \
+    (1 + NumTablePages(InitialDirDepth) + (1 << InitialDirDepth))
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
 // The directory data structure can be stored in memory, or on disk.
-// When it is on disk, it is stored as a regular Nachos file.
+// When it is on disk, it is stored as a regular Nachos file, organized
+// as an extendible hash: a header page, a table of 2^globalDepth
+// pointers to buckets, and the buckets themselves, one per page.  The
+// low globalDepth bits of a name's hash index the table, so a lookup
+// reads one table page and one bucket however big the directory is.
 //
 // The constructor initializes a directory structure in memory; the
 // FetchFrom/WriteBack operations shuffle the directory information
-// from/to disk.
+// from/to disk.  FetchFrom does not read anything: a page is read
+// from the file the first time an operation needs it, and only pages
+// that were changed are written back.
 
 class Directory {
   public:
-    Directory(int size); // Initialize an empty directory
-                         // with space for "size" files
-    ~Directory();        // De-allocate the directory
+    Directory();  // Initialize an empty directory
+    ~Directory(); // De-allocate the directory
 
     void FetchFrom(OpenFile *file); // Init directory contents from disk
     void WriteBack(OpenFile *file); // Write modifications to
@@ -76,22 +126,103 @@ class Directory {
                   //  names and their contents.
     /* MP4 */
     bool IsDir(char *name);
-	int tableSize;         // Number of directory entries
-    DirectoryEntry *table; // Table of pairs:
-                           // <file name, file header location>
+
+    int NumSlots() { return (1 << Header()->globalDepth) * DirEntriesPerBucket; }
+                                  // Number of entry slots, used or not
+    DirectoryEntry *Slot(int i);  // Entry slot "i", or NULL if "i"
+                                  //   repeats a bucket seen earlier
+
   private:
     /*
             MP4 Hint:
             Directory is actually a "file", be careful of how it works with
        OpenFile and FileHdr.
-            Disk part: table
-            In-core part: tableSize
+            Disk part: header, pointer table, buckets
+            In-core part: pages, dirty, file
     */
 
-    
+    int maxPages;   // Size of the pages and dirty arrays
+    char **pages;   // pages[p] -- in-core copy of page p,
+                    //   or NULL if it has not been read
+    bool *dirty;    // dirty[p] -- does page p need writing back?
+    OpenFile *file; // File the pages are read from, or
+                    //   NULL for a directory built in memory
+
+    char *Page(int p);      // Page "p", read in if need be
+    char *NewPage(int p);   // Page "p", cleared and marked dirty
+    void MarkDirty(int p) { dirty[p] = TRUE; }
+    void DropPages();       // Forget every in-core page
+
+    DirectoryHeader *Header() { return (DirectoryHeader *)Page(0); }
+    DirectoryBucket *Bucket(int p) { return (DirectoryBucket *)Page(p); }
+
+    int TableEntry(int index);  // Page of the bucket table entry
+                                //   "index" points to
+    void SetTableEntry(int start, int index, int page);
+                                // Point entry "index" of the table
+                                //   starting at page "start" at "page"
+
+    int AllocPage();        // Take a page for a new bucket
+    void FreePage(int p);   // Put page "p" on the free list
+    bool DoubleTable();     // Add one bit to the global depth
+    bool Split(int index);  // Split the bucket table entry
+                            //   "index" points to
+
+    DirectoryEntry *FindEntry(char *name, int *page);
+                            // Find the entry for "name", and
+                            //   the page holding it
+};
+
+// The following class defines an entry of the name cache.  An entry
+// with sector -1 records that the name is known not to be there.
+
+class NameCacheEntry {
+  public:
+    int dirSector;                 // Header sector of the directory
+                                   //   looked in, or -1 if unused
+    char name[FileNameMaxLen + 1]; // Name looked up
+    int sector;                    // Header sector it names, or -1
+    bool isDir;                    // Does it name a directory?
+    int prev, next;                // Neighbours in LRU order
+    int hashNext;                  // Next entry in the same hash chain
+};
+
+#define NameCacheSize 128 // # lookups the file system remembers
 
-    int FindIndex(char *name); // Find the index into the directory
-                               //  table corresponding to "name"
+// The following class defines a cache of directory lookups, from
+// <directory, name> to the sector of the name's file header.  Paths
+// are resolved through it, so a warm lookup of a deep path reads no
+// directory at all.  Directories are named by the sector of their file
+// header, which is what stays the same while a directory exists.
+//
+// Callers keep it up to date: whoever adds or removes a name enters
+// the new answer, and a removed directory's names are purged, since
+// its header sector may be reused.
+
+class NameCache {
+  public:
+    NameCache(int size); // Initialize an empty cache of "size" lookups
+    ~NameCache();        // De-allocate the cache
+
+    bool Lookup(int dirSector, char *name, int *sector, bool *isDir);
+                         // Return TRUE and the remembered answer,
+                         //   if there is one
+    void Enter(int dirSector, char *name, int sector, bool isDir);
+                         // Remember an answer, -1 for "not there"
+    void Purge(int dirSector); // Forget every name in a directory
+
+  private:
+    int size;                // Number of entries
+    NameCacheEntry *entries; // The entries
+    int *hashTable;          // Heads of the hash chains
+    int lruHead, lruTail;    // Most and least recently used entry
+    Lock *lock;              // Serializes access to the cache
+
+    int Hash(int dirSector, char *name);
+    int FindEntry(int dirSector, char *name);
+    void Touch(int e);       // Make entry "e" the most recently used
+    void Unlink(int e);      // Take entry "e" out of the LRU list
+    void HashRemove(int e);  // Take entry "e" out of its hash chain
 };
 
 #endif // DIRECTORY_H
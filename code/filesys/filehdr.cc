@@ -3,12 +3,11 @@
 //	would be called the i-node).
 //
 //	The file header is used to locate where on disk the
-//	file's data is stored.  We implement this as a fixed size
-//	table of pointers -- each entry in the table points to the
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector,
+//	file's data is stored.  We implement this as a list of extents
+//	-- each extent is a run of contiguous disk sectors holding
+//	consecutive blocks of the file.  The first few extents live in
+//	the header sector itself; any further extents are kept in a chain
+//	of extent blocks.
 //
 //      Unlike in a real system, we do not keep track of file permissions,
 //	ownership, last modification date, etc., in the file header.
@@ -27,6 +26,7 @@
 #include "filehdr.h"
 #include "debug.h"
 #include "synchdisk.h"
+#include "synch.h"
 #include "main.h"
 
 //----------------------------------------------------------------------
@@ -40,152 +40,261 @@
 FileHeader::FileHeader() {
     numBytes = -1;
     numSectors = -1;
-    memset(dataSectors, -1, sizeof(dataSectors));
-    nextFileHeader = NULL;
-    nextFileHeaderSector = -1;
+    numExtents = 0;
+    numWritten = 0;
+    firstBlock = -1;
+    memset(inlineData, 0, InlineSize);
+    maxExtents = NumDirectExtents;
+    extents = new Extent[maxExtents];
+    extentOffset = new int[maxExtents];
+    numLoaded = 0;
+    loadedSectors = 0;
+    nextBlock = -1;
+    blockSectors = NULL;
+    numBlocks = 0;
 }
 
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileHeader::~FileHeader
-//	Currently, there is not need to do anything in destructor function.
-//	However, if you decide to add some "in-core" data in header
-//	Always remember to deallocate their space or you will leak memory
+//	De-allocate the in-core extent map.
 //----------------------------------------------------------------------
 FileHeader::~FileHeader() {
-    if(nextFileHeader != NULL)
-        delete nextFileHeader;
+    delete[] extents;
+    delete[] extentOffset;
+    delete[] blockSectors;
 }
 
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
-//	Allocate data blocks for the file out of the map of free disk blocks.
-//	Return FALSE if there are not enough free blocks to accomodate
-//	the new file.
+//	Allocate data blocks for the file out of the map of free disk blocks,
+//	plus as many extent blocks as are needed to describe them.
+//	Return 0 if there are not enough free blocks to accomodate
+//	the new file, otherwise the size of the header in bytes.
+//
+//	None of the data blocks is written: until they are, they read as
+//	zeros.  A file of at most InlineSize bytes gets no data blocks; it
+//	is kept in the header.
+//
+//	The data goes in one contiguous run at or after "hint" if there
+//	is one (see AllocateSectors).  Passing the sector just past the
+//	file's header keeps the header and data together, so reading the
+//	file costs no seek between them.
 //
 //	"freeMap" is the bit map of free disk sectors
-//	"fileSize" is the bit map of free disk sectors
+//	"fileSize" is the number of bytes in the new file
+//	"hint" is where the data should start, or -1 for anywhere
 //----------------------------------------------------------------------
 
-int FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize) {
-	int file_size = (int)(fileSize);
-	int max_file_size = (int)(MaxFileSize);
-    if(file_size > max_file_size){
-        numBytes = max_file_size;
-    }else{
-        numBytes = file_size;
+int FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize, int hint) {
+    int sectorsNeeded = divRoundUp(fileSize, SectorSize);
+
+    ResetExtents();
+    numBytes = fileSize;
+    numWritten = 0;
+    memset(inlineData, 0, InlineSize);
+    if (fileSize <= InlineSize)
+        return SectorSize; // inline: just the header
+    if (freeMap->NumClear() < sectorsNeeded)
+        return 0;
+
+    AllocateSectors(freeMap, sectorsNeeded, hint);
+    numSectors = loadedSectors;
+    numExtents = numLoaded;
+
+    if (!AddExtentBlocks(freeMap)) {
+        Deallocate(freeMap);
+        return 0;
     }
-    
-    numSectors = divRoundUp(numBytes, SectorSize);
-    
-    if(freeMap->NumClear() < numSectors){
+    return (1 + numBlocks) * SectorSize; // fileheader size
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Extend
+// 	Make the file "newSize" bytes long, if it is shorter.  If the
+//	sectors already allocated to the file cannot hold that many bytes,
+//	allocate a batch of new ones (see MinGrowSectors), as a run right
+//	after the file's last sector if possible, plus any extent blocks
+//	needed to describe them.  New sectors are not written; they come
+//	after every written one, so they read as zeros.
+//
+//	An inline file stays inline as long as it fits.  Past that, its
+//	data is written to its first new sector (at "hint" if possible),
+//	and the extents take its place in the header.
+//
+//	Return the number of sectors allocated (0 if the file already had
+//	room), or -1, leaving the file alone, if there is not enough free
+//	space.  The caller must write the header back; if sectors were
+//	allocated, the free map too.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newSize" is the new length of the file in bytes
+//	"hint" is where the data should start if the file has no data
+//	    sectors yet, or -1 for anywhere
+//----------------------------------------------------------------------
+
+int FileHeader::Extend(PersistentBitmap *freeMap, int newSize, int hint) {
+    int needed = divRoundUp(newSize, SectorSize) - numSectors;
+    int batch, worstBlocks;
+    bool gotBlocks;
+
+    if (needed <= 0 || (IsInline() && newSize <= InlineSize)) {
+        numBytes = max(numBytes, newSize);
         return 0;
-    }else{
-        for(int i=0; i<numSectors; i++){
-            dataSectors[i] = freeMap->FindAndSet();
-            ASSERT(dataSectors[i] >= 0);
-        
-            // clean sector
-            char clean[SectorSize];   
-            for(int j=0 ; j<SectorSize; j++)   
-                clean[j] = 0;
-            kernel->synchDisk->WriteSector(dataSectors[i], clean);
-        }   
-        if((file_size - max_file_size) > 0){
-			
-            nextFileHeaderSector = freeMap->FindAndSet();   
-            ASSERT(nextFileHeaderSector >= 0);
-            
-            nextFileHeader = new FileHeader;
-            return SectorSize + nextFileHeader->Allocate(freeMap, file_size - max_file_size);           
-        }
     }
-    return SectorSize; // fileheader size
+    LoadAll();
+
+    // Try for a full batch, but settle for what is needed.  Reserve
+    // room for the extent blocks needed if no new sector is contiguous.
+    batch = max(needed, min(max(numSectors, MinGrowSectors), MaxGrowSectors));
+    worstBlocks = divRoundUp(max(numExtents + batch - NumDirectExtents, 0),
+                             NumBlockExtents) - numBlocks;
+    if (freeMap->NumClear() < batch + worstBlocks) {
+        batch = needed;
+        worstBlocks = divRoundUp(max(numExtents + batch - NumDirectExtents, 0),
+                                 NumBlockExtents) - numBlocks;
+        if (freeMap->NumClear() < batch + worstBlocks)
+            return -1;
+    }
+
+    if (numLoaded > 0)
+        hint = extents[numLoaded - 1].start + extents[numLoaded - 1].length;
+    if (IsInline() && numBytes > 0) {
+        char buf[SectorSize];
+
+        memset(buf, 0, SectorSize);
+        memcpy(buf, inlineData, numBytes);
+        AllocateSectors(freeMap, batch, hint);
+        kernel->synchDisk->WriteSector(extents[0].start, buf);
+        numWritten = 1;
+    } else {
+        AllocateSectors(freeMap, batch, hint);
+    }
+    numSectors = loadedSectors;
+    numExtents = numLoaded;
+    gotBlocks = AddExtentBlocks(freeMap);
+    ASSERT(gotBlocks); // room was reserved above
+    numBytes = newSize;
+    return batch;
 }
 
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
-// 	De-allocate all the space allocated for data blocks for this file.
+// 	De-allocate all the space allocated for data blocks for this file,
+//	and for the extent blocks describing them.
 //
 //	"freeMap" is the bit map of free disk sectors
 //----------------------------------------------------------------------
 
-void FileHeader::Deallocate(PersistentBitmap *freeMap) {  
-    for (int i = 0; i < numSectors; i++) {
-        ASSERT(freeMap->Test((int)dataSectors[i])); // ought to be marked!
-        freeMap->Clear((int)dataSectors[i]);
+void FileHeader::Deallocate(PersistentBitmap *freeMap) {
+    LoadAll();
+    for (int i = 0; i < numLoaded; i++) {
+        for (int j = 0; j < extents[i].length; j++) {
+            int sector = extents[i].start + j;
+            ASSERT(freeMap->Test(sector)); // ought to be marked!
+            freeMap->Clear(sector);
+        }
+    }
+    for (int i = 0; i < numBlocks; i++) {
+        ASSERT(freeMap->Test(blockSectors[i]));
+        freeMap->Clear(blockSectors[i]);
     }
-    if(nextFileHeader != NULL)
-        nextFileHeader->Deallocate(freeMap);    
 }
 
 //----------------------------------------------------------------------
 // FileHeader::FetchFrom
-// 	Fetch contents of file header from disk.
+// 	Fetch contents of file header from disk.  Only the header sector
+//	is read; the extent blocks are read later, when they are needed.
+//	An inline file's data comes in with the header.
 //
 //	"sector" is the disk sector containing the file header
 //----------------------------------------------------------------------
 
 void FileHeader::FetchFrom(int sector) {
-    //kernel->synchDisk->ReadSector(sector, (char *)this);
-
-    /*
-            MP4 Hint:
-            After you add some in-core informations, you will need to rebuild
-       the header's structure
-    */
     char buf[SectorSize];
+    Extent *diskExtents;
+    int count;
+
     kernel->synchDisk->ReadSector(sector, buf);
-    
-    int offset = sizeof(numBytes);
-    memcpy(&numBytes, buf, sizeof(numBytes));
-    memcpy(&numSectors, buf + offset, sizeof(numSectors));  
-    offset += sizeof(numSectors);
-    memcpy(&nextFileHeaderSector, buf + offset, sizeof(nextFileHeaderSector)); 
-    offset += sizeof(nextFileHeaderSector);
-    memcpy(dataSectors, buf + offset, NumDirect * sizeof(int));
-
-    if(nextFileHeaderSector != -1){
-       nextFileHeader = new FileHeader; 
-       nextFileHeader->FetchFrom(nextFileHeaderSector);
+
+    ResetExtents();
+    memcpy(&numBytes, buf, sizeof(int));
+    memcpy(&numSectors, buf + sizeof(int), sizeof(int));
+    memcpy(&numExtents, buf + 2 * sizeof(int), sizeof(int));
+    memcpy(&firstBlock, buf + 3 * sizeof(int), sizeof(int));
+    memcpy(&numWritten, buf + 4 * sizeof(int), sizeof(int));
+    diskExtents = (Extent *)(buf + 5 * sizeof(int));
+    if (IsInline()) {
+        memcpy(inlineData, diskExtents, InlineSize);
+        return;
     }
+
+    count = min(numExtents, NumDirectExtents);
+    for (int i = 0; i < count; i++)
+        AppendExtent(diskExtents[i].start, diskExtents[i].length);
+
+    nextBlock = firstBlock;
+    if (firstBlock != -1)
+        blockSectors = new int[divRoundUp(numExtents - NumDirectExtents,
+                                          NumBlockExtents)];
 }
 
 //----------------------------------------------------------------------
 // FileHeader::WriteBack
-// 	Write the modified contents of the file header back to disk.
+// 	Write the modified contents of the file header back to disk,
+//	along with its extent blocks.
 //
 //	"sector" is the disk sector to contain the file header
 //----------------------------------------------------------------------
 
 void FileHeader::WriteBack(int sector) {
-    //kernel->synchDisk->WriteSector(sector, (char *)this);
-
-    /*
-            MP4 Hint:
-            After you add some in-core informations, you may not want to write
-       all fields into disk.
-            Use this instead:
-            char buf[SectorSize];
-            memcpy(buf + offset, &dataToBeWritten, sizeof(dataToBeWritten));
-            ...
-    */
     char buf[SectorSize];
-    int offset = sizeof(numBytes);
-    
-    // numBytes, numSectors, nextFileHeaderSector, dataSector    
-    memcpy(buf , &numBytes, sizeof(numBytes));
-    memcpy(buf + offset, &numSectors, sizeof(numSectors)); 
-    offset += sizeof(numSectors);
-    memcpy(buf + offset, &nextFileHeaderSector, sizeof(nextFileHeaderSector)); 
-    offset += sizeof(nextFileHeaderSector);
-    memcpy(buf + offset, dataSectors, NumDirect*sizeof(int));
-    kernel->synchDisk->WriteSector(sector, buf);
+    int count, next, done;
+
+    LoadAll();
+    WriteBackHeader(sector);
 
-    if(nextFileHeaderSector != -1){
-        nextFileHeader->WriteBack(nextFileHeaderSector);
+    done = min(numLoaded, NumDirectExtents);
+    for (int b = 0; b < numBlocks; b++) {
+        next = (b + 1 < numBlocks) ? blockSectors[b + 1] : -1;
+        count = min(numExtents - done, NumBlockExtents);
+        memset(buf, 0, SectorSize);
+        memcpy(buf, &next, sizeof(int));
+        memcpy(buf + sizeof(int), &count, sizeof(int));
+        memcpy(buf + 2 * sizeof(int), extents + done, count * sizeof(Extent));
+        kernel->synchDisk->WriteSector(blockSectors[b], buf);
+        done += count;
     }
+    ASSERT(done == numExtents);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::WriteBackHeader
+// 	Write the header sector back to disk, leaving the extent blocks
+//	alone.  This is enough when only the file length, or the count of
+//	written sectors, or an inline file's data, has changed.
+//	The extents kept in the header sector are always in memory.
+//
+//	"sector" is the disk sector to contain the file header
+//----------------------------------------------------------------------
+
+void FileHeader::WriteBackHeader(int sector) {
+    char buf[SectorSize];
+
+    ASSERT(numLoaded >= min(numExtents, NumDirectExtents));
+    memset(buf, 0, SectorSize);
+    memcpy(buf, &numBytes, sizeof(int));
+    memcpy(buf + sizeof(int), &numSectors, sizeof(int));
+    memcpy(buf + 2 * sizeof(int), &numExtents, sizeof(int));
+    memcpy(buf + 3 * sizeof(int), &firstBlock, sizeof(int));
+    memcpy(buf + 4 * sizeof(int), &numWritten, sizeof(int));
+    if (IsInline())
+        memcpy(buf + 5 * sizeof(int), inlineData, InlineSize);
+    else
+        memcpy(buf + 5 * sizeof(int), extents,
+               min(numExtents, NumDirectExtents) * sizeof(Extent));
+    kernel->synchDisk->WriteSector(sector, buf);
 }
 
 //----------------------------------------------------------------------
@@ -195,16 +304,31 @@ void FileHeader::WriteBack(int sector) {
 //	offset in the file) to a physical address (the sector where the
 //	data at the offset is stored).
 //
+//	We binary search for the last extent starting at or before the
+//	block holding the byte, first reading in extent blocks until the
+//	loaded extents cover it.
+//
 //	"offset" is the location within the file of the byte in question
 //----------------------------------------------------------------------
 
-int FileHeader::ByteToSector(int offset) { 
-   int sector = offset / SectorSize;
-    if (sector < NumDirect) // within NumDirect
-        return (dataSectors[sector]);
-    else {
-        return nextFileHeader->ByteToSector(offset - (int)MaxFileSize);
+int FileHeader::ByteToSector(int offset) {
+    int block = offset / SectorSize;
+    int lo, hi;
+
+    ASSERT(block >= 0 && block < numSectors);
+    while (block >= loadedSectors)
+        LoadNextBlock();
+
+    lo = 0;
+    hi = numLoaded - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (extentOffset[mid] <= block)
+            lo = mid;
+        else
+            hi = mid - 1;
     }
+    return extents[lo].start + (block - extentOffset[lo]);
 }
 
 //----------------------------------------------------------------------
@@ -212,13 +336,46 @@ int FileHeader::ByteToSector(int offset) {
 // 	Return the number of bytes in the file.
 //----------------------------------------------------------------------
 
-int FileHeader::FileLength() { 
-    int totalNumBytes = numBytes;
-    
-    if(nextFileHeader != NULL){
-        totalNumBytes += nextFileHeader->FileLength();
+int FileHeader::FileLength() { return numBytes; }
+
+//----------------------------------------------------------------------
+// FileHeader::MarkWritten
+// 	Record that the first "sectors" data blocks of the file have all
+//	been written.  Return TRUE if more were written than before, in
+//	which case the header needs writing back.
+//
+//	"sectors" is the number of blocks, from the first on, written
+//----------------------------------------------------------------------
+
+bool FileHeader::MarkWritten(int sectors) {
+    ASSERT(sectors <= numSectors);
+    if (sectors <= numWritten)
+        return FALSE;
+    numWritten = sectors;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::SequentialSeek
+// 	Return how many tracks the disk head has to cross, in all, to read
+//	the whole file in order: from the header to the first extent, and
+//	from the end of each extent to the start of the next.  Moving on
+//	to the next track inside an extent doesn't count.  Zero for a
+//	file in one run right after its header.
+//
+//	"sector" is the disk sector holding the file header
+//----------------------------------------------------------------------
+
+int FileHeader::SequentialSeek(int sector) {
+    int track = sector / SectorsPerTrack;
+    int tracks = 0;
+
+    LoadAll();
+    for (int i = 0; i < numLoaded; i++) {
+        tracks += abs(extents[i].start / SectorsPerTrack - track);
+        track = (extents[i].start + extents[i].length - 1) / SectorsPerTrack;
     }
-    return totalNumBytes;
+    return tracks;
 }
 
 //----------------------------------------------------------------------
@@ -228,31 +385,324 @@ int FileHeader::FileLength() {
 //----------------------------------------------------------------------
 
 void FileHeader::Print() {
-    // numSectors total sectors
     int i, j, k;
     char *data = new char[SectorSize];
-    // int tempNumSector = divRoundUp(numSectors, 32);
 
-    printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
-    for (i = 0; i < numSectors; i++) // dataIndex blocks
-        printf("%d ", dataSectors[i]);
+    LoadAll();
+    printf("FileHeader contents.  File size: %d.  File extents:\n", numBytes);
+    for (i = 0; i < numLoaded; i++)
+        printf("%d+%d ", extents[i].start, extents[i].length);
+    if (IsInline())
+        printf("(inline)");
     printf("\nFile contents:\n");
-    for (i = k = 0; i < numSectors; i++) {
-        int dataIndex[numSectors - NumDirect];
-        kernel->synchDisk->ReadSector(dataSectors[i], (char *)dataIndex);
-        for (int l; l < numSectors - NumDirect; l++) {
-            kernel->synchDisk->ReadSector(dataIndex[l], data);
-            for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
-                if ('\040' <= data[j] && data[j] <= '\176') // isprint(data[j])
-                    printf("%c", data[j]);
-                else
-                    printf("\\%x", (unsigned char)data[j]);
-            }
-            printf("\n");
+    for (i = k = 0; i < max(numSectors, IsInline() ? 1 : 0); i++) {
+        if (IsInline())
+            memcpy(data, inlineData, InlineSize);
+        else if (i < numWritten)
+            kernel->synchDisk->ReadSector(ByteToSector(i * SectorSize), data);
+        else
+            memset(data, 0, SectorSize); // never written
+        for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
+            if ('\040' <= data[j] && data[j] <= '\176') // isprint(data[j])
+                printf("%c", data[j]);
+            else
+                printf("\\%x", (unsigned char)data[j]);
         }
         printf("\n");
     }
-    
-    if(nextFileHeader != NULL) nextFileHeader->Print();
     delete[] data;
 }
+
+//----------------------------------------------------------------------
+// FileHeader::LoadNextBlock
+// 	Read the next extent block in the chain, and add its extents to
+//	the in-core extent map.
+//----------------------------------------------------------------------
+
+void FileHeader::LoadNextBlock() {
+    char buf[SectorSize];
+    Extent *diskExtents;
+    int count;
+
+    ASSERT(nextBlock != -1);
+    blockSectors[numBlocks++] = nextBlock;
+    kernel->synchDisk->ReadSector(nextBlock, buf);
+    memcpy(&nextBlock, buf, sizeof(int));
+    memcpy(&count, buf + sizeof(int), sizeof(int));
+    diskExtents = (Extent *)(buf + 2 * sizeof(int));
+    for (int i = 0; i < count; i++)
+        AppendExtent(diskExtents[i].start, diskExtents[i].length);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::LoadAll
+// 	Make sure the whole extent map is in memory.
+//----------------------------------------------------------------------
+
+void FileHeader::LoadAll() {
+    while (nextBlock != -1)
+        LoadNextBlock();
+    ASSERT(numLoaded == numExtents && loadedSectors == numSectors);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateSectors
+// 	Allocate "count" data sectors and append them to the file.  They
+//	are not written (see MarkWritten).  The sectors are taken in
+//	contiguous runs: first we look for a run of all "count" of them,
+//	at or after "hint" (wrapping around); if the disk is too
+//	fragmented for that, for runs half as long, and so on.  A
+//	fragmented disk thus still gives the file as few extents as it
+//	can.  There must be "count" free sectors.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"count" is the number of sectors to add
+//	"hint" is where the first run should start, or -1 for anywhere
+//----------------------------------------------------------------------
+
+void FileHeader::AllocateSectors(PersistentBitmap *freeMap, int count,
+                                 int hint) {
+    int run = count;
+
+    ASSERT(freeMap->NumClear() >= count);
+    while (count > 0) {
+        int first;
+
+        run = min(run, count);
+        while ((first = freeMap->FindAndSetRange(run, hint)) == -1) {
+            run /= 2;
+            ASSERT(run > 0); // a single sector is always free
+        }
+        AddRun(first, run);
+        hint = first + run;
+        count -= run;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AddRun
+// 	Append a run of data sectors to the end of the file, extending the
+//	last extent when the run immediately follows it on disk.
+//
+//	"start" is the disk sector holding the first new block
+//	"length" is the number of sectors in the run
+//----------------------------------------------------------------------
+
+void FileHeader::AddRun(int start, int length) {
+    if (numLoaded > 0 &&
+        extents[numLoaded - 1].start + extents[numLoaded - 1].length ==
+            start) {
+        extents[numLoaded - 1].length += length;
+        loadedSectors += length;
+    } else {
+        AppendExtent(start, length);
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AppendExtent
+// 	Add a new extent after the ones already in memory, growing the
+//	in-core extent map if it is full.
+//
+//	"start", "length" describe the run of sectors to add
+//----------------------------------------------------------------------
+
+void FileHeader::AppendExtent(int start, int length) {
+    if (numLoaded == maxExtents) {
+        Extent *newExtents = new Extent[2 * maxExtents];
+        int *newOffset = new int[2 * maxExtents];
+        memcpy(newExtents, extents, numLoaded * sizeof(Extent));
+        memcpy(newOffset, extentOffset, numLoaded * sizeof(int));
+        delete[] extents;
+        delete[] extentOffset;
+        extents = newExtents;
+        extentOffset = newOffset;
+        maxExtents *= 2;
+    }
+    extents[numLoaded].start = start;
+    extents[numLoaded].length = length;
+    extentOffset[numLoaded] = loadedSectors;
+    numLoaded++;
+    loadedSectors += length;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AddExtentBlocks
+// 	Allocate however many more extent blocks it takes to hold all
+//	numExtents extents.  Return FALSE, allocating none, if there are
+//	not enough free sectors.  The whole extent map must be loaded.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool FileHeader::AddExtentBlocks(PersistentBitmap *freeMap) {
+    int needed = 0;
+    int *newSectors;
+
+    if (numExtents > NumDirectExtents)
+        needed = divRoundUp(numExtents - NumDirectExtents, NumBlockExtents);
+    if (needed <= numBlocks)
+        return TRUE;
+    if (freeMap->NumClear() < needed - numBlocks)
+        return FALSE;
+
+    newSectors = new int[needed];
+    for (int i = 0; i < needed; i++) {
+        if (i < numBlocks) {
+            newSectors[i] = blockSectors[i];
+        } else {
+            newSectors[i] = freeMap->FindAndSet();
+            ASSERT(newSectors[i] >= 0);
+        }
+    }
+    delete[] blockSectors;
+    blockSectors = newSectors;
+    numBlocks = needed;
+    firstBlock = blockSectors[0];
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ResetExtents
+// 	Forget the extent map and extent block chain, leaving an empty file.
+//----------------------------------------------------------------------
+
+void FileHeader::ResetExtents() {
+    numSectors = 0;
+    numExtents = 0;
+    firstBlock = -1;
+    numLoaded = 0;
+    loadedSectors = 0;
+    nextBlock = -1;
+    delete[] blockSectors;
+    blockSectors = NULL;
+    numBlocks = 0;
+}
+
+//----------------------------------------------------------------------
+// InodeKey, InodeHash
+// 	Key and hash function for the i-node table: an i-node is found
+//	by its header sector.
+//----------------------------------------------------------------------
+
+static int InodeKey(Inode *inode) { return inode->sector; }
+
+static unsigned InodeHash(int sector) { return (unsigned)sector; }
+
+//----------------------------------------------------------------------
+// InodeTable::InodeTable
+// 	Initialize an empty i-node table.
+//----------------------------------------------------------------------
+
+InodeTable::InodeTable() {
+    table = new HashTable<int, Inode *>(InodeKey, InodeHash);
+    lock = new Lock("inode table");
+}
+
+//----------------------------------------------------------------------
+// InodeTable::~InodeTable
+// 	De-allocate the table.  Any i-node still in it is freed without
+//	being written back; see Flush.
+//----------------------------------------------------------------------
+
+InodeTable::~InodeTable() {
+    while (!table->IsEmpty()) {
+        HashIterator<int, Inode *> iter(table);
+        Inode *inode = table->Remove(iter.Item()->sector);
+
+        delete inode->hdr;
+        delete inode;
+    }
+    delete table;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Get
+// 	Return the i-node for the file whose header is at "sector",
+//	reading the header in if nobody has the file open yet.  Each Get
+//	must be matched by a Put.
+//----------------------------------------------------------------------
+
+Inode *InodeTable::Get(int sector) {
+    Inode *inode;
+
+    lock->Acquire();
+    if (!table->Find(sector, &inode)) {
+        inode = new Inode;
+        inode->sector = sector;
+        inode->hdr = new FileHeader;
+        inode->hdr->FetchFrom(sector);
+        inode->refCount = 0;
+        inode->dirty = FALSE;
+        inode->removed = FALSE;
+        table->Insert(inode);
+    }
+    inode->refCount++;
+    lock->Release();
+    return inode;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Put
+// 	Drop a reference to "inode".  When the last one goes, the header
+//	is written back if it is dirty, and the i-node is freed.  If the
+//	file has been deleted, its sectors are freed instead.
+//----------------------------------------------------------------------
+
+void InodeTable::Put(Inode *inode) {
+    bool last;
+
+    lock->Acquire();
+    ASSERT(inode->refCount > 0);
+    last = (--inode->refCount == 0);
+    if (last && !inode->removed) {
+        if (inode->dirty)
+            inode->hdr->WriteBackHeader(inode->sector);
+        (void)table->Remove(inode->sector);
+    }
+    lock->Release();
+
+    if (last) {
+        if (inode->removed)
+            kernel->fileSystem->FreeFile(inode); // not under our lock
+        delete inode->hdr;
+        delete inode;
+    }
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Discard
+// 	Note that the file of "inode" has been deleted.  It leaves the
+//	table, and its header is never written back.  Whoever still has
+//	it open keeps it, sectors and all, until the last Put frees them.
+//----------------------------------------------------------------------
+
+void InodeTable::Discard(Inode *inode) {
+    lock->Acquire();
+    if (!inode->removed) {
+        (void)table->Remove(inode->sector);
+        inode->removed = TRUE;
+        inode->dirty = FALSE;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Flush
+// 	Write back the header of every dirty i-node.  Called before Nachos
+//	halts, as files left open are never Put.
+//----------------------------------------------------------------------
+
+void InodeTable::Flush() {
+    lock->Acquire();
+    for (HashIterator<int, Inode *> iter(table); !iter.IsDone(); iter.Next()) {
+        Inode *inode = iter.Item();
+
+        if (inode->dirty) {
+            inode->hdr->WriteBackHeader(inode->sector);
+            inode->dirty = FALSE;
+        }
+    }
+    lock->Release();
+}
@@ -16,21 +16,66 @@
 
 #include "disk.h"
 #include "pbitmap.h"
+#include "hash.h"
 
-#define NumDirect ((SectorSize - 3 * sizeof(int)) / sizeof(int))
-#define MaxFileSize (NumDirect * SectorSize)
-#define MaxFileSize_1 (NumDirect * NumDirect * SectorSize)
+class Lock;
+
+// The following class defines an "extent" -- a run of physically
+// contiguous disk sectors holding consecutive data blocks of a file.
+
+class Extent {
+  public:
+    int start;  // First disk sector of the run
+    int length; // Number of sectors in the run
+};
+
+// Number of extents stored in the header sector itself, and in each
+// extent block chained off of it.
+#define NumDirectExtents \
+    ((int)((SectorSize - 5 * sizeof(int)) / sizeof(Extent)))
+#define NumBlockExtents \
+    ((int)((SectorSize - 2 * sizeof(int)) / sizeof(Extent)))
+
+// Largest file whose data is kept in the header sector, where the
+// extents would otherwise go.
+#define InlineSize ((int)(SectorSize - 5 * sizeof(int)))
+
+// Number of sectors added at a time when a file grows past the space
+// allocated to it: as many as it already has, but at least
+// MinGrowSectors and at most MaxGrowSectors.
+#define MinGrowSectors 4
+#define MaxGrowSectors SectorsPerTrack
 
 // The following class defines the Nachos "file header" (in UNIX terms,
 // the "i-node"), describing where on disk to find all of the data in the file.
-// The file header is organized as a simple table of pointers to
-// data blocks.
+// The file data is described as a list of extents, in file order.
 //
-// The file header data structure can be stored in memory or on disk.
-// When it is on disk, it is stored in a single sector -- this means
-// that we assume the size of this data structure to be the same
-// as one disk sector.  Without indirect addressing, this
-// limits the maximum file length to just under 4K bytes.
+// On disk, the file header is stored in a single sector holding the
+// file length and the first NumDirectExtents extents.  If the file has
+// more extents than that, the rest are kept in a chain of extent
+// blocks, each holding up to NumBlockExtents extents plus the sector
+// of the next block in the chain.
+//
+// In memory, the extents are kept in one array, along with the
+// index of the first file block covered by each extent, so that
+// ByteToSector can binary search for the extent covering an offset.
+// FetchFrom only reads the header sector; extent blocks are read in
+// as ByteToSector first needs the extents they hold.
+//
+// A file can grow after it is created.  Space is added in batches,
+// so the file may own a few more data sectors than its length needs.
+//
+// A file of at most InlineSize bytes has no data sectors at all: its
+// data is kept in the header sector, in place of the extents.  Reading
+// it takes one disk read, and writing it changes only the header.  The
+// file moves to a data sector of its own when it grows past InlineSize.
+//
+// Data sectors are not cleared when they are allocated.  Instead the
+// header counts how many blocks, from the start of the file, have
+// been written; the blocks after those read as zeros without going
+// to the disk (see OpenFile).  Creating a file thus costs the same
+// whatever its initial size, and a file never shows what its sectors
+// held before they were given to it.
 //
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
@@ -43,15 +88,31 @@ class FileHeader {
     ~FileHeader();
 
     int Allocate(PersistentBitmap *bitMap,
-                  int fileSize);               // Initialize a file header,
+                  int fileSize,
+                  int hint = -1);              // Initialize a file header,
                                                //  including allocating space
-                                               //  on disk for the file data
+                                               //  on disk for the file data,
+                                               //  at or after sector "hint"
+                                               //  if possible; return the
+                                               //  header size in bytes, or 0
+                                               //  on failure
     void Deallocate(PersistentBitmap *bitMap); // De-allocate this file's
                                                //  data blocks
+    int Extend(PersistentBitmap *bitMap,
+               int newSize,
+               int hint = -1);                 // Make the file "newSize"
+                                               //  bytes long, putting any
+                                               //  first data sectors at
+                                               //  "hint"; return the #
+                                               //  of sectors allocated,
+                                               //  or -1 if the disk is full
 
     void FetchFrom(int sectorNumber); // Initialize file header from disk
     void WriteBack(int sectorNumber); // Write modifications to file header
                                       //  back to disk
+    void WriteBackHeader(int sectorNumber);
+                                      // Write back the header sector only,
+                                      //  enough if just the length changed
 
     int ByteToSector(int offset); // Convert a byte offset into the file
                                   // to the disk sector containing
@@ -60,34 +121,101 @@ class FileHeader {
     int FileLength(); // Return the length of the file
                       // in bytes
 
+    int WrittenSectors() { return numWritten; } // # of blocks, from the
+                                                //  start, holding data
+    bool MarkWritten(int sectors); // Blocks up to "sectors" hold data
+                                   //  now; TRUE if that is news
+
+    int NumExtents() { return numExtents; } // # of pieces the file's
+                                            //  data is in
+
+    bool IsInline() { return numSectors == 0; } // Is the data kept in
+                                                //  the header sector?
+    char *InlineData() { return inlineData; }   // That data, if so
+
+    int SequentialSeek(int sector); // Tracks the disk head crosses
+                                    //  to read the file through,
+                                    //  from its header at "sector"
+
     void Print(); // Print the contents of the file.
 
   private:
-    /*
-            MP4 hint:
-            You will need a data structure to store more information in a
-       header.
-            Fields in a class can be separated into disk part and in-core part.
-            Disk part are data that will be written into disk.
-            In-core part are data only lies in memory, and are used to maintain
-       the data structure of this class.
-            In order to implement a data structure, you will need to add some
-       "in-core" data
-            to maintain data structure.
-
-            Disk Part - numBytes, numSectors, dataSectors occupy exactly 128
-       bytes and will be
-            written to a sector on disk.
-            In-core part - none
-
-    */
-
-    int numBytes;               // Number of bytes in the file
-    int numSectors;             // Number of data sectors in the file
-    int dataSectors[NumDirect]; // Disk sector numbers for each data
-                                // block in the file
-    int nextFileHeaderSector;
-    FileHeader* nextFileHeader; 
+    // Disk part -- written to the header sector
+    int numBytes;   // Number of bytes in the file
+    int numSectors; // Number of data sectors in the file
+    int numExtents; // Number of extents describing the data
+    int numWritten; // Number of data sectors, from the first on,
+                    // that have been written
+    int firstBlock; // Sector of the first extent block, -1 if none
+
+    char inlineData[InlineSize]; // The data of an inline file;
+                                 // written in place of the extents
+
+    // In-core part -- rebuilt by FetchFrom
+    Extent *extents;   // Extents loaded so far, in file order
+    int *extentOffset; // extentOffset[i] is the index of the first
+                       // file block in extents[i]
+    int maxExtents;    // Allocated size of extents and extentOffset
+    int numLoaded;     // Number of extents loaded in memory
+    int loadedSectors; // Number of file blocks covered by them
+    int nextBlock;     // Next extent block to load, -1 if none left
+    int *blockSectors; // Sectors holding the extent block chain
+    int numBlocks;     // Number of extent blocks loaded (or allocated)
+
+    void LoadNextBlock();         // Read in the next extent block
+    void LoadAll();               // Read in every remaining extent block
+    void AllocateSectors(PersistentBitmap *freeMap, int count, int hint);
+                                  // Add "count" new data sectors to the
+                                  // file, in as few runs as the free map
+                                  // allows
+    void AddRun(int start, int length);
+                                  // Append a run of data sectors to the
+                                  // file, growing the last extent if the
+                                  // run follows it
+    void AppendExtent(int start, int length);
+    bool AddExtentBlocks(PersistentBitmap *freeMap);
+                                  // Allocate enough extent blocks to
+                                  // hold every extent
+    void ResetExtents();          // Forget all extents
+};
+
+// The following class defines an in-core "i-node": the one copy of a
+// file header in memory, shared by every OpenFile on the file.
+
+class Inode {
+  public:
+    int sector;       // Disk sector holding the header
+    FileHeader *hdr;  // The header
+    int refCount;     // Number of users (OpenFiles, mostly)
+    bool dirty;       // Has the length or the count of written
+                      //   sectors changed since the header was
+                      //   last written back?
+    bool removed;     // Has the file been deleted?  Its sectors
+                      //   are freed by the last Put
+};
+
+// The following class defines the table of in-core i-nodes, keyed by
+// header sector.  The first Get of a file reads its header in; the
+// last Put writes the header back if only its length or written count
+// changed (any change to the file's sectors is written back at once,
+// with the free map), and frees it.
+
+class InodeTable {
+  public:
+    InodeTable();  // Initialize an empty table
+    ~InodeTable(); // De-allocate the table
+
+    Inode *Get(int sector);   // Return the i-node of the file whose
+                              //   header is at "sector", with one
+                              //   more reference
+    void Put(Inode *inode);   // Drop a reference to "inode"
+    void Discard(Inode *inode); // The file was deleted: never write
+                                //   its header back
+    void Flush();             // Write back every dirty header
+
+  private:
+    HashTable<int, Inode *> *table; // The i-nodes in use
+    Lock *lock;                     // Serializes access to the table
 };
 
 #endif // FILEHDR_H
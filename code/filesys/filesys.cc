@@ -19,7 +19,13 @@
 //	on bootup.
 //
 //	The file system assumes that the bitmap and directory files are
-//	kept "open" continuously while Nachos is running.
+//	kept "open" continuously while Nachos is running.  The bitmap
+//	itself is also kept in memory; only the sectors of it that an
+//	operation changes are written back to the bitmap file.
+//
+//	Looking a name up in a directory is remembered in a name cache,
+//	so a path walked recently is resolved without reading any
+//	directory.  Create and Remove enter their results in the cache.
 //
 //	For those operations (such as Create, Remove) that modify the
 //	directory and/or bitmap, if the operation succeeds, the changes
@@ -31,10 +37,6 @@
 // 	Our implementation at this point has the following restrictions:
 //
 //	   there is no synchronization for concurrent accesses
-//	   files have a fixed size, set when the file is created
-//	   files cannot be bigger than about 3KB in size
-//	   there is no hierarchical directory structure, and only a limited
-//	     number of files can be added to the system
 //	   there is no attempt to make the system robust to failures
 //	    (if Nachos exits in the middle of an operation that modifies
 //	    the file system, it may corrupt the disk)
@@ -51,6 +53,9 @@
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "synch.h"
+#include "synchdisk.h"
+#include "main.h"
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
@@ -60,24 +65,35 @@
 //	not all of the sectors marked as free).
 //
 //	If format = FALSE, we just have to open the files
-//	representing the bitmap and the directory.
+//	representing the bitmap and the directory, and read the
+//	bitmap into memory.
+//
+//	Either way, the journal is opened first; when mounting, that
+//	replays the operations logged in it.
 //
 //	"format" -- should we initialize the disk?
+//	"journalData" -- when formatting, should every write, not just
+//		those of file system operations, go through the log?
 //----------------------------------------------------------------------
 
-FileSystem::FileSystem(bool format)
+FileSystem::FileSystem(bool format, bool journalData)
 {
     /* MP4 */
     for (int i = 0; i < MAXFILENUM; i++)
         fileDescriptorTable[i] = NULL;
     openedNum = 0;
 
+    freeMapLock = new Lock("free map lock");
+    nameCache = new NameCache(NameCacheSize);
+
     DEBUG(dbgFile, "Initializing the file system.");
+    kernel->synchDisk->OpenJournal(JournalSector, JournalSectors, format,
+                                   journalData);
     if (format)
     {
-        PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
+        freeMap = new PersistentBitmap(NumSectors);
 
-        Directory *directory = new Directory(NumDirEntries);
+        Directory *directory = new Directory;
         FileHeader *mapHdr = new FileHeader;
         FileHeader *dirHdr = new FileHeader;
 
@@ -89,6 +105,8 @@ FileSystem::FileSystem(bool format)
         //cout<<"m1 "<<freeMap->NumClear()<<'\n';
         freeMap->Mark(DirectorySector);
         //cout<<"m2 "<<freeMap->NumClear()<<'\n';
+        for (int i = 0; i < JournalSectors; i++)
+            freeMap->Mark(JournalSector + i);
         // Second, allocate space for the data blocks containing the contents
         // of the directory and bitmap files.  There better be enough space!
 
@@ -127,7 +145,6 @@ FileSystem::FileSystem(bool format)
             freeMap->Print();
             directory->Print();
         }
-        delete freeMap;
         delete directory;
         delete mapHdr;
         delete dirHdr;
@@ -138,6 +155,7 @@ FileSystem::FileSystem(bool format)
         // the bitmap and directory; these are left open while Nachos is running
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
+        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
     }
 }
 
@@ -147,6 +165,9 @@ FileSystem::FileSystem(bool format)
 //----------------------------------------------------------------------
 FileSystem::~FileSystem()
 {
+    delete freeMap;
+    delete freeMapLock;
+    delete nameCache;
     delete freeMapFile;
     delete directoryFile;
 }
@@ -154,8 +175,8 @@ FileSystem::~FileSystem()
 //----------------------------------------------------------------------
 // FileSystem::Create
 // 	Create a file in the Nachos file system (similar to UNIX create).
-//	Since we can't increase the size of files dynamically, we have
-//	to give Create the initial size of the file.
+//	Space for "initialSize" bytes is allocated up front; the file
+//	grows later if it is written past its end.
 //
 //	The steps to create a file are:
 //	  Make sure the file doesn't already exist
@@ -167,6 +188,9 @@ FileSystem::~FileSystem()
 //
 //	Return TRUE if everything goes ok, otherwise, return FALSE.
 //
+//	All the writes are one journal operation, so after a crash the
+//	file either exists, with its space allocated, or doesn't.
+//
 // 	Create fails if:
 //   		file is already in directory
 //	 	no free space for file header
@@ -183,17 +207,16 @@ FileSystem::~FileSystem()
 bool FileSystem::Create(char *path, int initialSize, bool isDir)
 {
     Directory *directory;
-    PersistentBitmap *freeMap;
     FileHeader *hdr;
     int sector;
-    bool success;
+    bool success, op;
 
     DEBUG(dbgFile, "Creating file " << path << " size " << initialSize);
 
     if (isDir)
         initialSize = DirectoryFileSize;
 
-    directory = new Directory(NumDirEntries);
+    directory = new Directory;
     /* MP4 */
     char targetPath[500];
     strcpy(targetPath, path);
@@ -205,6 +228,7 @@ bool FileSystem::Create(char *path, int initialSize, bool isDir)
         return FALSE;
     }
     directory->FetchFrom(curDirFile);
+    op = kernel->synchDisk->BeginOp();
 
     cout << "Start creating file: " << targetPath << "\n";
 
@@ -212,8 +236,9 @@ bool FileSystem::Create(char *path, int initialSize, bool isDir)
         success = FALSE; // file is already in directory
     else
     {
-        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-        sector = freeMap->FindAndSet(); // find a sector to hold the file header
+        freeMapLock->Acquire();
+        // find a sector to hold the file header
+        sector = freeMap->FindAndSet(HeaderHint(curDirFile, isDir));
         if (sector == -1)
         {
             success = FALSE; // no free block for file header
@@ -222,16 +247,19 @@ bool FileSystem::Create(char *path, int initialSize, bool isDir)
         else if (!directory->Add(targetPath, sector, isDir))
         {
             success = FALSE; // no space in directory
+            freeMap->Clear(sector);
             cout << "   ---> Create fail\n";
         }
         else
         {
             hdr = new FileHeader;
             /* MP4 */
-            int totalSize = hdr->Allocate(freeMap, initialSize);
+            // put the data right after the header
+            int totalSize = hdr->Allocate(freeMap, initialSize, sector + 1);
             if (totalSize == 0)
             {
                 success = FALSE; // no space on disk for data
+                freeMap->Clear(sector);
                 cout << "   ---> Create fail\n";
             }
             else
@@ -239,16 +267,33 @@ bool FileSystem::Create(char *path, int initialSize, bool isDir)
                 success = TRUE;
                 // everthing worked, flush all changes back to disk
                 hdr->WriteBack(sector);
-                directory->WriteBack(curDirFile);
                 freeMap->WriteBack(freeMapFile);
                 cout << "   ---> Create success, total header's size:  " << totalSize << " B"
                      << "\n\n";
             }
             delete hdr;
         }
-        delete freeMap;
+        freeMapLock->Release();
+
+        // the directory file may have to grow, which takes freeMapLock
+        if (success)
+        {
+            directory->WriteBack(curDirFile);
+            nameCache->Enter(curDirFile->HeaderSector(), targetPath, sector, isDir);
+            if (isDir)
+            {
+                Directory *newDir = new Directory;
+                OpenFile *newDirFile = new OpenFile(sector);
+
+                newDir->WriteBack(newDirFile);
+                delete newDirFile;
+                delete newDir;
+            }
+        }
     } /* MP4 */
 
+    if (op)
+        kernel->synchDisk->EndOp();
     if (curDirFile != directoryFile)
         delete curDirFile;
     delete directory;
@@ -256,6 +301,115 @@ bool FileSystem::Create(char *path, int initialSize, bool isDir)
     return success;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::HeaderHint
+// 	Return the sector from which to look for a free sector to hold the
+//	header of a new file; its data then follows the header.
+//
+//	A file goes in the block group of its directory: we look from the
+//	directory's own header on.  So does a new directory, as long as
+//	that group still has at least half the average number of free
+//	sectors per group; once it is fuller than that, the directory
+//	goes at the start of the group with the most free sectors (the
+//	first such, if there is a tie), so directories spread out over
+//	the disk as it fills.  Either way, if the group is full, the
+//	search goes on into the next group.
+//
+//	Spreading directories before a group fills up costs more than it
+//	saves: the root, the free map and the journal stay in the first
+//	group, and every operation in a far directory seeks back to them.
+//
+//	The free map lock must be held.
+//
+//	"dirFile" -- the directory the file is going in
+//	"isDir" -- is the new file a directory?
+//----------------------------------------------------------------------
+
+int FileSystem::HeaderHint(OpenFile *dirFile, bool isDir)
+{
+    int parent = dirFile->HeaderSector();
+    int parentFree = 0, totalFree = 0;
+    int best = 0, bestFree = -1;
+
+    if (!isDir)
+        return parent;
+    for (int g = 0; g < NumGroups; g++)
+    {
+        int numFree = freeMap->NumClearIn(g * SectorsPerGroup,
+                                          SectorsPerGroup);
+        if (numFree > bestFree)
+        {
+            best = g;
+            bestFree = numFree;
+        }
+        if (g == parent / SectorsPerGroup)
+            parentFree = numFree;
+        totalFree += numFree;
+    }
+    if (parentFree * NumGroups * 2 >= totalFree)
+        return parent;
+    return best * SectorsPerGroup;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FreeFile
+// 	Give back the header and data sectors of a deleted file, once
+//	nobody has it open any more, writing the free map back to disk as
+//	one journal operation (part of the caller's, if it is in one).
+//	Called by InodeTable::Put.
+//
+//	"inode" -- the in-core header of the file
+//----------------------------------------------------------------------
+
+void FileSystem::FreeFile(Inode *inode)
+{
+    bool op = kernel->synchDisk->BeginOp();
+
+    freeMapLock->Acquire();
+    inode->hdr->Deallocate(freeMap); // remove data blocks
+    freeMap->Clear(inode->sector);   // remove header block
+    freeMap->WriteBack(freeMapFile); // flush to disk
+    freeMapLock->Release();
+    if (op)
+        kernel->synchDisk->EndOp();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ExtendFile
+// 	Make a file "newSize" bytes long, allocating more data sectors
+//	from the free map if it needs them.  If it did, the header and
+//	the free map are written back together, as one journal operation;
+//	if only the length changed, the header is left for the i-node
+//	table to write back.
+//
+//	Return FALSE, leaving the file as it was, if the disk is full.
+//
+//	"inode" -- the in-core header of the file
+//	"newSize" -- the length the file should have
+//----------------------------------------------------------------------
+
+bool FileSystem::ExtendFile(Inode *inode, int newSize)
+{
+    int allocated;
+    bool op = kernel->synchDisk->BeginOp();
+
+    freeMapLock->Acquire();
+    allocated = inode->hdr->Extend(freeMap, newSize, inode->sector + 1);
+    if (allocated > 0)
+    {
+        inode->hdr->WriteBack(inode->sector);
+        freeMap->WriteBack(freeMapFile);
+    }
+    else if (allocated == 0)
+    {
+        inode->dirty = TRUE;
+    }
+    freeMapLock->Release();
+    if (op)
+        kernel->synchDisk->EndOp();
+    return allocated >= 0;
+}
+
 //----------------------------------------------------------------------
 // FileSystem::Open
 // 	Open a file for reading and writing.
@@ -268,30 +422,23 @@ bool FileSystem::Create(char *path, int initialSize, bool isDir)
 
 std::pair<OpenFile *, OpenFileId> FileSystem::Open(char *path)
 {
-    Directory *directory = new Directory(NumDirEntries);
     OpenFile *openFile = NULL;
-    int sector;
+    int dirSector, sector;
+    bool isDir;
 
     /* MP4 */
     char targetPath[500];
     strcpy(targetPath, path);
-    OpenFile *curDirFile = FindSubDir(targetPath);
-    if (curDirFile == NULL)
-    {
-        delete directory;
+    dirSector = FindParent(targetPath);
+    if (dirSector == -1)
         return make_pair((OpenFile *)NULL, -1);
-    }
     cout << "Start opening file: " << targetPath << "\n";
     DEBUG(dbgFile, "Opening file" << targetPath);
-    directory->FetchFrom(curDirFile);
-    sector = directory->Find(targetPath);
+    sector = LookupName(dirSector, targetPath, &isDir);
     /* MP4 */
     if (openedNum == MAXFILENUM) // fileDescriptorTable has no space
     {
         cout << "   ---> Open fail\n\n";
-        if (curDirFile != directoryFile)
-            delete curDirFile; /* MP4 */
-        delete directory;
         return make_pair((OpenFile *)NULL, -1);
     }
 
@@ -301,9 +448,6 @@ std::pair<OpenFile *, OpenFileId> FileSystem::Open(char *path)
     if (openFile == NULL)
     {
         cout << "   ---> Open fail\n\n";
-        if (curDirFile != directoryFile)
-            delete curDirFile; /* MP4 */
-        delete directory;
         return make_pair((OpenFile *)NULL, -1);
     }
     cout << "   ---> Open success\n\n";
@@ -315,16 +459,10 @@ std::pair<OpenFile *, OpenFileId> FileSystem::Open(char *path)
             fileDescriptorTable[ID] = openFile;
             openedNum++;
             cout << "openedNum = " << openedNum << " fileDescriptorTable[ID] = " << ID << '\n';
-            if (curDirFile != directoryFile)
-                delete curDirFile; /* MP4 */
-            delete directory;
             return make_pair((OpenFile *)openFile, ID);
         }
     }
 
-    if (curDirFile != directoryFile)
-        delete curDirFile; /* MP4 */
-    delete directory;
     return make_pair((OpenFile *)NULL, -1); // return NULL if not found
 }
 
@@ -336,6 +474,10 @@ std::pair<OpenFile *, OpenFileId> FileSystem::Open(char *path)
 //	    Delete the space for its data blocks
 //	    Write changes to directory, bitmap back to disk
 //
+//	If the file is still open, only its name goes now; its space is
+//	freed (see FreeFile) when the last OpenFile on it is deleted, so
+//	it can still be read and written until then.
+//
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
 //	in the file system.
 //
@@ -345,11 +487,11 @@ std::pair<OpenFile *, OpenFileId> FileSystem::Open(char *path)
 bool FileSystem::Remove(bool recursion, char *path)
 {
     Directory *directory;
-    PersistentBitmap *freeMap;
-    FileHeader *fileHdr;
+    Inode *inode;
     int sector;
+    bool op;
 
-    directory = new Directory(NumDirEntries);
+    directory = new Directory;
 
     /* MP4 */
     char targetPath[500];
@@ -374,10 +516,11 @@ bool FileSystem::Remove(bool recursion, char *path)
         return FALSE; // file not found
     }
 
-    if (directory->IsDir(targetPath) && recursion)
+    bool isDir = directory->IsDir(targetPath);
+    if (isDir && recursion)
     {
         // fetch subdirectory from disk
-        Directory *subDir = new Directory(NumDirEntries);
+        Directory *subDir = new Directory;
         OpenFile *subDirFile = new OpenFile(sector);
         subDir->FetchFrom(subDirFile);
 
@@ -387,12 +530,14 @@ bool FileSystem::Remove(bool recursion, char *path)
         targetPath[offset] = '/';
 
         // Remove all things in the target directory
-        for (int i = 0; i < subDir->tableSize; i++)
+        for (int i = 0; i < subDir->NumSlots(); i++)
         {
-            if (subDir->table[i].inUse)
+            DirectoryEntry *entry = subDir->Slot(i);
+
+            if (entry != NULL && entry->inUse)
             {
                 //update tragetPath
-                strcpy(targetPath + offset + 1, subDir->table[i].name);
+                strcpy(targetPath + offset + 1, entry->name);
                 Remove(recursion, targetPath);
             }
         }
@@ -400,23 +545,26 @@ bool FileSystem::Remove(bool recursion, char *path)
         delete subDirFile;
     }
 
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
+    // the file may be open; its sectors are freed by the last Put of
+    // its in-core header, here or when the last opener closes it
+    inode = kernel->inodeTable->Get(sector);
+    op = kernel->synchDisk->BeginOp(); // unlinking it is atomic
 
-    freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-
-    fileHdr->Deallocate(freeMap); // remove data blocks
-    freeMap->Clear(sector);       // remove header block
     directory->Remove(targetPath);
-
-    freeMap->WriteBack(freeMapFile);  // flush to disk
     directory->WriteBack(curDirFile); // flush to disk
+    kernel->inodeTable->Discard(inode);
+    kernel->inodeTable->Put(inode);
+
+    if (op)
+        kernel->synchDisk->EndOp();
+
+    nameCache->Enter(curDirFile->HeaderSector(), targetPath, -1, FALSE);
+    if (isDir)
+        nameCache->Purge(sector); // its header sector may be reused
 
-    delete fileHdr;
     if (curDirFile != directoryFile)
         delete curDirFile; /* MP4 */
     delete directory;
-    delete freeMap;
     cout << "   ---> Remove success\n\n";
     return FALSE;
 }
@@ -430,7 +578,7 @@ void FileSystem::List(bool recursion, char *dirPath)
 {
     if (strcmp(dirPath, "/") == 0)
     { // root directory
-        Directory *directory = new Directory(NumDirEntries);
+        Directory *directory = new Directory;
         directory->FetchFrom(directoryFile);
         cout << "List  \"/\"" << endl;
         directory->List(recursion, 0);
@@ -446,13 +594,13 @@ void FileSystem::List(bool recursion, char *dirPath)
         OpenFile *conDirFile = FindSubDir(targetPath);
         if (conDirFile == NULL) // no such dir
             return;
-        Directory *conDir = new Directory(NumDirEntries);
+        Directory *conDir = new Directory;
         conDir->FetchFrom(conDirFile);
 
         int targetSector = conDir->Find(targetPath);
         ASSERT(targetSector >= 0);
         OpenFile *targetDirFile = new OpenFile(targetSector);
-        Directory *targetDir = new Directory(NumDirEntries);
+        Directory *targetDir = new Directory;
         targetDir->FetchFrom(targetDirFile);
 
         cout << "List \"" << targetPath << "\"" << endl;
@@ -480,8 +628,9 @@ void FileSystem::Print()
 {
     FileHeader *bitHdr = new FileHeader;
     FileHeader *dirHdr = new FileHeader;
-    PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-    Directory *directory = new Directory(NumDirEntries);
+    Directory *directory = new Directory;
+
+    kernel->inodeTable->Flush(); // so the headers read below are current
 
     printf("Bit map file header:\n");
     bitHdr->FetchFrom(FreeMapSector);
@@ -496,55 +645,169 @@ void FileSystem::Print()
     directory->FetchFrom(directoryFile);
     directory->Print();
 
+    int numFiles = 0, numExtents = 0, seekTracks = 0;
+    Fragmentation(DirectorySector, &numFiles, &numExtents, &seekTracks);
+    if (numFiles > 0)
+        printf("Fragmentation: %d files, %.2f extents per file, "
+               "%.2f tracks of seek per sequential read\n",
+               numFiles, (double)numExtents / numFiles,
+               (double)seekTracks / numFiles);
+
     delete bitHdr;
     delete dirHdr;
-    delete freeMap;
     delete directory;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Fragmentation
+// 	Walk every file and directory under a directory, adding up how
+//	many there are, how many extents their data is in, and how many
+//	tracks the disk head would cross reading each one through (see
+//	FileHeader::SequentialSeek).  The directory itself isn't counted.
+//	Files laid out well have one extent each and no seek.
+//
+//	"dirSector" is the header sector of the directory to walk
+//	"numFiles", "numExtents", "seekTracks" are the running totals
+//----------------------------------------------------------------------
+
+void FileSystem::Fragmentation(int dirSector, int *numFiles,
+                               int *numExtents, int *seekTracks)
+{
+    OpenFile *dirFile = new OpenFile(dirSector);
+    Directory *directory = new Directory;
+
+    directory->FetchFrom(dirFile);
+    for (int i = 0; i < directory->NumSlots(); i++)
+    {
+        DirectoryEntry *entry = directory->Slot(i);
+        FileHeader *hdr;
+
+        if (entry == NULL || !entry->inUse)
+            continue;
+        hdr = new FileHeader;
+        hdr->FetchFrom(entry->sector);
+        (*numFiles)++;
+        *numExtents += hdr->NumExtents();
+        *seekTracks += hdr->SequentialSeek(entry->sector);
+        delete hdr;
+        if (entry->isDir)
+            Fragmentation(entry->sector, numFiles, numExtents, seekTracks);
+    }
+    delete directory;
+    delete dirFile;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FindSubDir
+// 	Open the directory holding the file named by "subDirPath", and
+//	cut "subDirPath" down to the file's own name.  Return NULL if the
+//	path is empty.
+//
+//	The caller deletes the returned file, unless it is the root
+//	directory's, which stays open.
+//----------------------------------------------------------------------
+
 OpenFile *FileSystem::FindSubDir(char *subDirPath)
+{
+    int dirSector = FindParent(subDirPath);
+
+    if (dirSector == -1)
+        return NULL;
+    if (dirSector == DirectorySector)
+        return directoryFile;
+    return new OpenFile(dirSector);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FindParent
+// 	Walk "path" down from the root, and return the header sector of
+//	the directory holding its last name; "path" is overwritten with
+//	that name.  The walk stops early at a name that is not a
+//	directory, and that name is the one returned.  Return -1 if the
+//	path is empty.
+//
+//	Each step goes through the name cache, so walking a path that
+//	was walked recently reads no directories.
+//----------------------------------------------------------------------
+
+int FileSystem::FindParent(char *path)
 {
     char *delim = "/";
-    char *token = strtok(subDirPath, delim);
-    char *nextToken = "";
+    char *token = strtok(path, delim);
+    char *nextToken;
+    int dirSector = DirectorySector;
 
-    OpenFile *curDirFile = directoryFile;
-    Directory *curDir = new Directory(NumDirEntries);
-    curDir->FetchFrom(directoryFile);
     if (token == NULL)
+        return -1;
+
+    nextToken = strtok(NULL, delim);
+    while (nextToken != NULL)
     {
-        delete curDir;
-        return NULL;
-    }
-    else
-    {
+        bool isDir;
+        int sector = LookupName(dirSector, token, &isDir);
+
+        if (sector == -1 || !isDir)
+            break;
+        dirSector = sector;
+        token = nextToken;
         nextToken = strtok(NULL, delim);
+    }
+    // end file
+    memmove(path, token, strlen(token) + 1);	// may overlap
+    return dirSector;
+}
 
-        while (nextToken != NULL && curDir->IsDir(token))
-        {
-            int sector = curDir->Find(token);
-            if (sector == -1)
-            {
-                delete curDir;
-                if (curDirFile != directoryFile)
-                    delete curDirFile;
-                return NULL;
-            }
-            else
-            {
-                if (curDirFile != directoryFile)
-                    delete curDirFile;
+//----------------------------------------------------------------------
+// FileSystem::DirectoryExists
+// 	Return TRUE if every name along "path" is a directory, so that
+//	"path" itself is an existing directory.  "/" always is.
+//----------------------------------------------------------------------
 
-                curDirFile = new OpenFile(sector);
-                curDir->FetchFrom(curDirFile);
-            }
-            token = nextToken;
-            nextToken = strtok(NULL, delim);
-        }
-        // end file
-        strcpy(subDirPath, token);
-        delete curDir;
-        return curDirFile;
+bool FileSystem::DirectoryExists(char *path)
+{
+    char targetPath[500];
+    char *token;
+    int dirSector = DirectorySector;
+    bool isDir = TRUE;
+
+    strcpy(targetPath, path);
+    for (token = strtok(targetPath, "/"); token != NULL && isDir;
+         token = strtok(NULL, "/"))
+    {
+        dirSector = LookupName(dirSector, token, &isDir);
+        if (dirSector == -1)
+            return FALSE;
     }
+    return isDir;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LookupName
+// 	Return the header sector of "name" in the directory whose header
+//	is at "dirSector", or -1 if the name isn't there, and set "isDir"
+//	to whether it is a directory.  The directory is only read if the
+//	name cache doesn't have the answer, which is then remembered.
+//----------------------------------------------------------------------
+
+int FileSystem::LookupName(int dirSector, char *name, bool *isDir)
+{
+    int sector;
+
+    if (nameCache->Lookup(dirSector, name, &sector, isDir))
+        return sector;
+
+    OpenFile *dirFile = (dirSector == DirectorySector)
+                            ? directoryFile : new OpenFile(dirSector);
+    Directory *dir = new Directory;
+
+    dir->FetchFrom(dirFile);
+    sector = dir->Find(name);
+    *isDir = (sector != -1) && dir->IsDir(name);
+    nameCache->Enter(dirSector, name, sector, *isDir);
+
+    delete dir;
+    if (dirFile != directoryFile)
+        delete dirFile;
+    return sector;
 }
 #endif // FILESYS_STUB
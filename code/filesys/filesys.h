@@ -39,6 +39,11 @@
 #include "syscall.h"
 #include "debug.h"
 
+class PersistentBitmap;
+class Lock;
+class Inode;
+class NameCache;
+
 #define MAXFILENUM 400
 
 // Sectors containing the file headers for the bitmap of free sectors,
@@ -47,12 +52,26 @@
 #define FreeMapSector 0
 #define DirectorySector 1
 
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number
-// of files that can be loaded onto the disk.
+// The journal, where metadata writes are logged before they go home
+// (see SynchDisk::OpenJournal), sits in a fixed run of sectors too.
+#define JournalSector 2
+#define JournalSectors (16 * SectorsPerTrack)
+
+// Initial file sizes for the bitmap and directory; a directory file
+// grows from there as files are added to it.
 #define FreeMapFileSize (NumSectors / BitsInByte)
-#define NumDirEntries 64 // Support up to 64 files/subdirectories per directory
-#define DirectoryFileSize (sizeof(DirectoryEntry) * NumDirEntries)
+
+// The disk is divided into block groups of consecutive tracks.  A new
+// file goes in the group of its directory, and so does a new directory
+// until that group fills up, when it goes in the group with the most
+// free space instead.  A directory, the headers of its files and their
+// data are thus close together, and directories spread across the disk
+// as it fills (as with the cylinder groups of BSD FFS).  Each group's
+// part of the free map covers its sectors.
+#define TracksPerGroup 256
+#define SectorsPerGroup (TracksPerGroup * SectorsPerTrack)
+#define NumGroups (divRoundUp(NumSectors, SectorsPerGroup))
+#define DirectoryFileSize (InitialDirPages * SectorSize)
 
 #ifdef FILESYS_STUB // Temporarily implement file system calls as
 // calls to UNIX, until the real file system
@@ -90,12 +109,14 @@ class FileSystem {
 
 class FileSystem {
   public:
-    FileSystem(bool format); // Initialize the file system.
+    FileSystem(bool format, bool journalData = FALSE);
+    // Initialize the file system.
     // Must be called *after* "synchDisk"
     // has been initialized.
     // If "format", there is nothing on
     // the disk, so initialize the directory
-    // and the bitmap of free blocks.
+    // and the bitmap of free blocks, and
+    // if "journalData", log every write.
     // MP4 mod tag
     ~FileSystem();
 
@@ -112,15 +133,42 @@ class FileSystem {
 
     OpenFile* FindSubDir(char* subDirPath); // Find the sub directory's openfile
 
+    bool DirectoryExists(char *path); // Is "path" an existing directory?
+
+    bool ExtendFile(Inode *inode, int newSize);
+    // Grow the file whose in-core header
+    // is "inode" to "newSize" bytes
+    void FreeFile(Inode *inode);
+    // Free the sectors of a deleted file
+    // nobody has open any more
+
     OpenFile* fileDescriptorTable[MAXFILENUM]; // fileID and openfile* map
     int openedNum; // how many file be opended
 
   private:
     OpenFile *freeMapFile;   // Bit map of free disk blocks,
                              // represented as a file
+    PersistentBitmap *freeMap; // In-memory copy of the free map, loaded
+                               // at mount and kept until shutdown
+    Lock *freeMapLock;       // Serializes updates to freeMap
     OpenFile *directoryFile; // "Root" directory -- list of
                              // file names, represented as a file
                              // TODO file id and pointer map
+    NameCache *nameCache;    // Recent directory lookups
+
+    int FindParent(char *path); // Header sector of the directory
+                                // holding "path"; "path" is cut
+                                // down to its last name
+    int LookupName(int dirSector, char *name, bool *isDir);
+                                // Header sector of "name" in the
+                                // directory at "dirSector", or -1
+    int HeaderHint(OpenFile *dirFile, bool isDir);
+                                // Where to look for a sector for a
+                                // new file's header
+    void Fragmentation(int dirSector, int *numFiles, int *numExtents,
+                       int *seekTracks);
+                                // Add up how scattered the files
+                                // under a directory are
 };
 
 #endif // FILESYS
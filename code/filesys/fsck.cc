@@ -0,0 +1,891 @@
+// fsck.cc
+//	A consistency checker for the Nachos file system.  It runs on the
+//	host, against a disk image (DISK_0 by default) that Nachos is not
+//	using, and is built as a program of its own ("make fsck").
+//
+//	The checker works in the same order as Nachos does when it mounts
+//	the disk:
+//
+//	   The whole image is read into memory, by several host threads.
+//	   The transactions committed to the journal are replayed over it,
+//	    as OpenJournal would, so the check sees what Nachos would see.
+//	   The directory tree is walked from DirectorySector.  Every
+//	    directory found is a job for the pool of host threads; a job
+//	    validates each of its entries' file headers and extent block
+//	    chains, and claims the sectors they use.  A sector claimed
+//	    twice is a double allocation.
+//	   The claims are compared, in parallel, with the free map: a sector
+//	    in use but free in the map may be handed out again, and one
+//	    marked in the map that nothing uses is a leak.
+//
+//	With -r, the checker repairs what it can: it writes the replayed
+//	journal home, drops directory entries whose file header is damaged
+//	or already used by another entry, and makes the free map agree
+//	with what the tree uses.  Data sectors shared by two files are
+//	only reported; which file they belong to is for the user to say.
+//
+//	The check is incremental: after a clean check the mount count in
+//	the journal header, which Nachos bumps each time it opens the
+//	disk, is noted in "<image>.fsck" with the image's modification and
+//	change times, and the next check of an image that has not changed
+//	since is skipped (unless -f is given).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "disk.h"
+#include "filehdr.h"
+#include "directory.h"
+#include "filesys.h"
+#include "synchdisk.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The layout of a disk image, as in machine/disk.cc.
+const int ImageMagic = 0x456789ab;
+const int ImageMagicSize = sizeof(int);
+const int ImageSize = ImageMagicSize + NumSectors * SectorSize;
+
+const int Unclaimed = -1;	// owner of a sector nothing uses
+const int JournalOwner = -2;	// owner of the journal's sectors
+
+const int MaxThreads = 64;	// most host threads used
+const int StampSize = 80;	// longest image stamp, with room to spare
+const int MaxReported = 20;	// most runs of leaked or unmarked
+				//  sectors listed one by one
+
+// Exit status, as fsck(8) has it.
+const int ExitClean = 0;
+const int ExitRepaired = 1;
+const int ExitErrors = 4;
+const int ExitFailed = 8;
+
+// The following class describes a file found in the tree: its header,
+// checked, and the disk sectors of its data blocks.
+
+class FileMap {
+  public:
+    int numBytes;	// Length of the file
+    int numSectors;	// # data sectors, 0 if the file is inline
+    int numWritten;	// # data blocks, from the first, written
+    int numExtents;	// # extents describing the data
+    Extent *extents;	// The extents, in file order
+    int numBlocks;	// # extent blocks
+    int *blocks;	// Sectors of the extent blocks
+
+    FileMap() { extents = NULL; blocks = NULL; }
+    ~FileMap() { delete [] extents; delete [] blocks; }
+
+    int BlockSector(int block);	// Sector of data block "block"
+    char *Page(int block);	// Contents of data block "block"
+};
+
+// The following class is a job for the thread pool: a directory to
+// check, and the path it was reached by.
+
+class DirJob {
+  public:
+    int sector;		// Header sector of the directory file
+    char *path;		// Its name, from the root
+    DirJob *next;	// Next job waiting
+};
+
+static char *imageName = (char *) "DISK_0";
+static bool repair = FALSE;
+static int numThreads;
+
+static char *disk;		// The image, less its magic number
+static bool *changed;		// changed[s] -- is sector s to be
+				//  written back?
+static int *owner;		// owner[s] -- header sector of the file
+				//  using sector s, or Unclaimed
+static char **paths;		// paths[h] -- name of the file whose
+				//  header is at sector h, if any
+static char zeros[SectorSize];	// A block that was never written
+
+static pthread_mutex_t reportLock = PTHREAD_MUTEX_INITIALIZER;
+static int numErrors;		// Problems found
+static int numFixed;		// ... and repaired
+
+// The list of data sectors found claimed twice, filled in by the walk
+// and reported once the name of every file is known.
+static int numConflicts, maxConflicts;
+static int *conflictSector, *conflictOwner;
+
+// The queue of directories waiting to be checked.
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueReady = PTHREAD_COND_INITIALIZER;
+static DirJob *queue;
+static int busy;		// # threads checking a directory
+
+static char *Sector(int s) { return disk + s * SectorSize; }
+
+//----------------------------------------------------------------------
+// Report
+// 	Print a problem with the file system, and count it.  "fixed" says
+//	whether it was repaired.
+//----------------------------------------------------------------------
+
+static void
+Report(bool fixed, const char *format, ...)
+{
+    va_list ap;
+
+    pthread_mutex_lock(&reportLock);
+    va_start(ap, format);
+    vprintf(format, ap);
+    va_end(ap);
+    printf(fixed ? " (fixed)\n" : "\n");
+    numErrors++;
+    if (fixed)
+        numFixed++;
+    pthread_mutex_unlock(&reportLock);
+}
+
+//----------------------------------------------------------------------
+// Claim
+// 	Record that sector "s" is used by the file whose header is at
+//	"who".  Return the owner it already had, or Unclaimed if it was
+//	free to take.  Any thread may call this.
+//----------------------------------------------------------------------
+
+static int
+Claim(int s, int who)
+{
+    return __sync_val_compare_and_swap(&owner[s], Unclaimed, who);
+}
+
+//----------------------------------------------------------------------
+// ClaimData
+// 	Claim the data sectors and extent blocks of a file, noting any
+//	of them already used by another file.
+//----------------------------------------------------------------------
+
+static void
+ClaimData(FileMap *map, int who)
+{
+    for (int i = 0; i < map->numExtents + map->numBlocks; i++) {
+        int start = (i < map->numExtents) ? map->extents[i].start
+                        : map->blocks[i - map->numExtents];
+        int length = (i < map->numExtents) ? map->extents[i].length : 1;
+
+        for (int s = start; s < start + length; s++) {
+            int other = Claim(s, who);
+
+            if (other != Unclaimed) {
+                pthread_mutex_lock(&reportLock);
+                if (numConflicts == maxConflicts) {
+                    maxConflicts = max(2 * maxConflicts, 16);
+                    conflictSector = (int *) realloc(conflictSector,
+                                            maxConflicts * sizeof(int));
+                    conflictOwner = (int *) realloc(conflictOwner,
+                                            maxConflicts * sizeof(int));
+                }
+                conflictSector[numConflicts] = s;
+                conflictOwner[numConflicts++] = who;
+                pthread_mutex_unlock(&reportLock);
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// LoadFile
+// 	Read and check the file header at sector "sector", and fill in
+//	"map" from it.  Return NULL if the header makes sense, otherwise
+//	what is wrong with it.  Nothing is claimed.
+//----------------------------------------------------------------------
+
+static const char *
+LoadFile(int sector, FileMap *map)
+{
+    int *hdr = (int *) Sector(sector);
+    int firstBlock, next, count, done, total;
+    Extent *diskExtents;
+
+    // the order FileHeader::WriteBackHeader writes them in
+    map->numBytes = hdr[0];
+    map->numSectors = hdr[1];
+    map->numExtents = hdr[2];
+    firstBlock = hdr[3];
+    map->numWritten = hdr[4];
+    map->numBlocks = 0;
+
+    if (map->numBytes < 0 || map->numSectors < 0 || map->numExtents < 0 ||
+        map->numSectors > NumSectors || map->numExtents > map->numSectors)
+        return "bad header";
+    if (map->numWritten < 0 || map->numWritten > map->numSectors)
+        return "bad count of written blocks";
+    if (map->numSectors == 0) {
+        if (map->numBytes > InlineSize || map->numExtents != 0 ||
+            firstBlock != -1)
+            return "bad inline file";
+        return NULL;
+    }
+    if (map->numBytes > map->numSectors * SectorSize)
+        return "length past its sectors";
+
+    map->extents = new Extent[map->numExtents];
+    map->blocks = new int[map->numExtents];
+    done = min(map->numExtents, NumDirectExtents);
+    memcpy(map->extents, hdr + 5, done * sizeof(Extent));
+    for (next = firstBlock; next != -1; next = hdr[0]) {
+        if (next < 0 || next >= NumSectors || done == map->numExtents)
+            return "bad extent block chain";
+        map->blocks[map->numBlocks++] = next;
+        hdr = (int *) Sector(next);
+        count = hdr[1];
+        if (count <= 0 || count > NumBlockExtents ||
+            count > map->numExtents - done)
+            return "bad extent block";
+        diskExtents = (Extent *) (hdr + 2);
+        memcpy(map->extents + done, diskExtents, count * sizeof(Extent));
+        done += count;
+    }
+    if (done != map->numExtents)
+        return "extent block chain too short";
+
+    total = 0;
+    for (int i = 0; i < map->numExtents; i++) {
+        Extent *e = &map->extents[i];
+
+        if (e->start < 0 || e->length <= 0 || e->start + e->length > NumSectors)
+            return "extent off the disk";
+        total += e->length;
+    }
+    if (total != map->numSectors)
+        return "extents do not add up to its size";
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// FileMap::BlockSector
+// 	Return the disk sector holding data block "block" of the file.
+//----------------------------------------------------------------------
+
+int
+FileMap::BlockSector(int block)
+{
+    for (int i = 0; i < numExtents; i++) {
+        if (block < extents[i].length)
+            return extents[i].start + block;
+        block -= extents[i].length;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FileMap::Page
+// 	Return the contents of data block "block", or NULL if the file
+//	has no such block.  A block never written reads as zeros.
+//----------------------------------------------------------------------
+
+char *
+FileMap::Page(int block)
+{
+    if (block < 0 || block >= numSectors)
+        return NULL;
+    return (block < numWritten) ? Sector(BlockSector(block)) : zeros;
+}
+
+//----------------------------------------------------------------------
+// AddJob
+// 	Queue directory "sector", named "path", to be checked.
+//----------------------------------------------------------------------
+
+static void
+AddJob(int sector, char *path)
+{
+    DirJob *job = new DirJob;
+
+    job->sector = sector;
+    job->path = path;
+    pthread_mutex_lock(&queueLock);
+    job->next = queue;
+    queue = job;
+    pthread_cond_signal(&queueReady);
+    pthread_mutex_unlock(&queueLock);
+}
+
+//----------------------------------------------------------------------
+// EnterFile
+// 	Check the file named by directory entry "entry", found in
+//	directory "dirPath" in bucket sector "bucketSector", and claim
+//	its sectors.  A directory is queued to be checked in turn.  If the
+//	entry is no good and we are repairing, drop it from the directory.
+//----------------------------------------------------------------------
+
+static void
+EnterFile(DirectoryEntry *entry, char *dirPath, int bucketSector)
+{
+    char name[FileNameMaxLen + 1];
+    char *path;
+    const char *problem;
+    FileMap map;
+    int other;
+
+    strncpy(name, entry->name, FileNameMaxLen);
+    name[FileNameMaxLen] = '\0';
+    path = new char[strlen(dirPath) + FileNameMaxLen + 2];
+    sprintf(path, "%s%s%s", dirPath, strcmp(dirPath, "/") ? "/" : "", name);
+
+    if (entry->sector < 0 || entry->sector >= NumSectors) {
+        problem = "header off the disk";
+    } else if ((problem = LoadFile(entry->sector, &map)) == NULL) {
+        other = Claim(entry->sector, entry->sector);
+        if (other != Unclaimed)
+            problem = "header already in use";
+    }
+    if (problem != NULL) {
+        if (repair) {
+            entry->inUse = FALSE;
+            changed[bucketSector] = TRUE;
+        }
+        Report(repair, "%s: %s, at sector %d", path, problem, entry->sector);
+        delete [] path;
+        return;
+    }
+
+    paths[entry->sector] = path;
+    ClaimData(&map, entry->sector);
+    if (entry->isDir)
+        AddJob(entry->sector, path);
+}
+
+//----------------------------------------------------------------------
+// CheckDirectory
+// 	Check the directory whose header is at "sector", named "path":
+//	its extendible hash structure, then each of its entries.  The
+//	directory's own header and data are already claimed.
+//----------------------------------------------------------------------
+
+static void
+CheckDirectory(int sector, char *path)
+{
+    FileMap map;
+    DirectoryHeader *hdr;
+    int numEntries, p;
+
+    if (LoadFile(sector, &map) != NULL)
+        return;				// reported when it was entered
+    hdr = (DirectoryHeader *) map.Page(0);
+    if (hdr == NULL || hdr->globalDepth < 0 ||
+        hdr->globalDepth > MaxDirDepth || hdr->tableStart <= 0 ||
+        map.Page(hdr->tableStart + NumTablePages(hdr->globalDepth) - 1)
+            == NULL) {
+        Report(FALSE, "%s: directory header damaged", path);
+        return;
+    }
+
+    numEntries = 1 << hdr->globalDepth;
+    for (int i = 0; i < numEntries; i++) {
+        int *table = (int *) map.Page(hdr->tableStart + i / DirPointersPerPage);
+        DirectoryBucket *bucket;
+
+        p = table[i % DirPointersPerPage];
+        bucket = (DirectoryBucket *) map.Page(p);
+        if (bucket == NULL || bucket->localDepth < 0 ||
+            bucket->localDepth > hdr->globalDepth) {
+            Report(FALSE, "%s: bucket table entry %d damaged", path, i);
+            continue;
+        }
+        if (i >= (1 << bucket->localDepth))
+            continue;			// seen through an earlier entry
+        for (int j = 0; j < DirEntriesPerBucket; j++) {
+            if (bucket->entry[j].inUse)
+                EnterFile(&bucket->entry[j], path,
+                          p < map.numWritten ? map.BlockSector(p) : -1);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// Walker
+// 	Body of a thread of the pool: check directories off the queue
+//	until it is empty and no other thread can add to it.
+//----------------------------------------------------------------------
+
+static void *
+Walker(void *)
+{
+    DirJob *job;
+
+    for (;;) {
+        pthread_mutex_lock(&queueLock);
+        while (queue == NULL && busy > 0)
+            pthread_cond_wait(&queueReady, &queueLock);
+        job = queue;
+        if (job == NULL) {		// all done
+            pthread_cond_broadcast(&queueReady);
+            pthread_mutex_unlock(&queueLock);
+            return NULL;
+        }
+        queue = job->next;
+        busy++;
+        pthread_mutex_unlock(&queueLock);
+
+        CheckDirectory(job->sector, job->path);
+        delete job;
+
+        pthread_mutex_lock(&queueLock);
+        busy--;
+        if (busy == 0 && queue == NULL)
+            pthread_cond_broadcast(&queueReady);
+        pthread_mutex_unlock(&queueLock);
+    }
+}
+
+//----------------------------------------------------------------------
+// RunThreads
+// 	Run "func" in numThreads host threads, giving thread i the
+//	argument i, and wait for all of them.
+//----------------------------------------------------------------------
+
+static void
+RunThreads(void *(*func)(void *))
+{
+    pthread_t threads[MaxThreads];
+
+    for (long i = 0; i < numThreads; i++)
+        pthread_create(&threads[i], NULL, func, (void *) i);
+    for (int i = 0; i < numThreads; i++)
+        pthread_join(threads[i], NULL);
+}
+
+static int imageFile;		// The image, opened
+
+//----------------------------------------------------------------------
+// ReadSlice
+// 	Body of a thread reading its share of the image into memory.
+//----------------------------------------------------------------------
+
+static void *
+ReadSlice(void *arg)
+{
+    long i = (long) arg;
+    int first = NumSectors / numThreads * i;
+    int last = (i == numThreads - 1) ? NumSectors
+                   : NumSectors / numThreads * (i + 1);
+    size_t size = (size_t) (last - first) * SectorSize;
+
+    if (pread(imageFile, Sector(first), size,
+              ImageMagicSize + (off_t) first * SectorSize) != (ssize_t) size)
+        memset(Sector(first), 0, size);	// caught by the size check
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// ReplayJournal
+// 	Apply the transactions committed to the journal to the image in
+//	memory, in order, up to the first record missing or incomplete,
+//	exactly as SynchDisk::OpenJournal does at mount.  When repairing,
+//	the replayed sectors are written home, and the journal emptied.
+//----------------------------------------------------------------------
+
+static void
+ReplayJournal()
+{
+    JournalHeader *header = (JournalHeader *) Sector(JournalSector);
+    int logStart = JournalSector + 1;
+    int logEnd = JournalSector + JournalSectors;
+    int pos = logStart, seq = 0, flags = 0;
+    int replayed = 0;
+
+    if (header->magic == JournalMagic) {
+        seq = header->seq;
+        flags = header->flags;
+        if (header->head > JournalSector && header->head <= logEnd)
+            pos = header->head;
+    }
+    for (;;) {
+        JournalRecord *record = NULL;
+
+        for (int at = pos; ; at = logStart) {	// where it fits, or at
+            JournalRecord *r = (JournalRecord *) Sector(at); // the start
+
+            if (at + 1 < logEnd && JournalRecordValid(r, seq, at, logEnd) &&
+                JournalChecksum(Sector(at + 1), r->count) == r->checksum) {
+                record = r;
+                pos = at;
+                break;
+            }
+            if (at == logStart)
+                break;
+        }
+        if (record == NULL)
+            break;
+        for (int i = 0; i < record->count; i++) {
+            int home = record->home[i];
+
+            if (home >= 0 && home < NumSectors) {
+                memcpy(Sector(home), Sector(pos + 1 + i), SectorSize);
+                changed[home] = repair;
+            }
+        }
+        pos += 1 + record->count;
+        seq++;
+        replayed++;
+    }
+
+    if (replayed > 0) {
+        if (repair) {
+            header->magic = JournalMagic;
+            header->seq = seq;
+            header->head = pos;
+            header->flags = flags;
+            changed[JournalSector] = TRUE;
+        }
+        printf("Replayed %d journal transaction%s%s\n", replayed,
+               replayed == 1 ? "" : "s",
+               repair ? "" : " (in memory only)");
+    }
+}
+
+// The free map, as a bitmap, and the file holding it.
+static unsigned *freeMap;
+static FileMap mapFile;
+
+// Runs of sectors found leaked or wrongly free, by each thread.
+class SectorRuns {
+  public:
+    int count, max;
+    int *start, *length;
+    bool *leaked;	// Marked in the map, but unused?
+};
+static SectorRuns runs[MaxThreads];
+
+static bool IsMarked(int s) { return (freeMap[s / 32] >> (s % 32)) & 1; }
+
+//----------------------------------------------------------------------
+// CompareSlice
+// 	Body of a thread comparing its share of the free map with the
+//	sectors claimed by the walk, noting runs of sectors on which they
+//	disagree, and (when repairing) correcting the map.  Slices are
+//	whole words of the map, so no two threads change the same word.
+//----------------------------------------------------------------------
+
+static void *
+CompareSlice(void *arg)
+{
+    long t = (long) arg;
+    int words = NumSectors / 32;
+    int first = words / numThreads * t * 32;
+    int last = (t == numThreads - 1) ? NumSectors
+                   : words / numThreads * (t + 1) * 32;
+    SectorRuns *r = &runs[t];
+
+    r->count = r->max = 0;
+    r->start = r->length = NULL;
+    r->leaked = NULL;
+    for (int s = first; s < last; s++) {
+        bool used = (owner[s] != Unclaimed);
+
+        if (used == IsMarked(s))
+            continue;
+        if (r->count > 0 && r->start[r->count - 1] + r->length[r->count - 1]
+                                == s && r->leaked[r->count - 1] == !used) {
+            r->length[r->count - 1]++;
+        } else {
+            if (r->count == r->max) {
+                r->max = max(2 * r->max, 16);
+                r->start = (int *) realloc(r->start, r->max * sizeof(int));
+                r->length = (int *) realloc(r->length, r->max * sizeof(int));
+                r->leaked = (bool *) realloc(r->leaked, r->max * sizeof(bool));
+            }
+            r->start[r->count] = s;
+            r->length[r->count] = 1;
+            r->leaked[r->count++] = !used;
+        }
+        if (repair)
+            freeMap[s / 32] ^= 1u << (s % 32);
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// CheckFreeMap
+// 	Compare the free map with the sectors the tree uses, in parallel,
+//	and report where they disagree.  When repairing, write the
+//	corrected map back to the free map file.
+//----------------------------------------------------------------------
+
+static void
+CheckFreeMap()
+{
+    int mapBlocks = divRoundUp(FreeMapFileSize, SectorSize);
+    int shown = 0, leaked = 0, unmarked = 0, lastChanged = -1;
+
+    freeMap = new unsigned[mapBlocks * SectorSize / sizeof(unsigned)];
+    for (int b = 0; b < mapBlocks; b++) {
+        char *page = mapFile.Page(b);
+
+        memcpy((char *) freeMap + b * SectorSize,
+               page != NULL ? page : zeros, SectorSize);
+    }
+    RunThreads(CompareSlice);
+
+    for (int t = 0; t < numThreads; t++) {
+        for (int i = 0; i < runs[t].count; i++) {
+            int start = runs[t].start[i], length = runs[t].length[i];
+
+            if (runs[t].leaked[i])
+                leaked += length;
+            else
+                unmarked += length;
+            if (shown++ < MaxReported)
+                printf("  sectors %d-%d: %s\n", start, start + length - 1,
+                       runs[t].leaked[i] ? "leaked" : "in use but free");
+        }
+        free(runs[t].start);
+        free(runs[t].length);
+        free(runs[t].leaked);
+    }
+    if (shown > MaxReported)
+        printf("  ... and %d more runs\n", shown - MaxReported);
+    if (leaked > 0)
+        Report(repair, "%d sectors marked in the free map are not used",
+               leaked);
+    if (unmarked > 0)
+        Report(repair, "%d sectors in use are free in the free map",
+               unmarked);
+    if (!repair || leaked + unmarked == 0)
+        return;
+
+    for (int b = 0; b < mapBlocks && b < mapFile.numSectors; b++) {
+        int s = mapFile.BlockSector(b);
+
+        if (b < mapFile.numWritten &&
+            memcmp(Sector(s), (char *) freeMap + b * SectorSize, SectorSize) == 0)
+            continue;
+        memcpy(Sector(s), (char *) freeMap + b * SectorSize, SectorSize);
+        changed[s] = TRUE;
+        lastChanged = b;
+    }
+    if (lastChanged >= mapFile.numWritten) {	// blocks before it were
+        ((int *) Sector(FreeMapSector))[4] = lastChanged + 1; // written too
+        changed[FreeMapSector] = TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// ReportConflicts
+// 	Report the data sectors found claimed by two files, by name.
+//----------------------------------------------------------------------
+
+static void
+ReportConflicts()
+{
+    for (int i = 0; i < numConflicts; i++) {
+        int s = conflictSector[i];
+        int first = owner[s], second = conflictOwner[i];
+
+        Report(FALSE, "sector %d is used by both %s and %s", s,
+               first == JournalOwner ? "the journal"
+                   : paths[first] ? paths[first] : "?",
+               paths[second] ? paths[second] : "?");
+    }
+}
+
+//----------------------------------------------------------------------
+// WriteChanges
+// 	Write every sector changed by a repair back to the image.
+//----------------------------------------------------------------------
+
+static bool
+WriteChanges()
+{
+    int written = 0;
+
+    for (int s = 0; s < NumSectors; s++) {
+        if (!changed[s])
+            continue;
+        if (pwrite(imageFile, Sector(s), SectorSize,
+                   ImageMagicSize + (off_t) s * SectorSize) != SectorSize) {
+            perror(imageName);
+            return FALSE;
+        }
+        written++;
+    }
+    if (written > 0)
+        printf("Wrote %d repaired sectors\n", written);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// ImageStamp
+// 	Describe the image as it is now on the host: the mount count from
+//	its journal header, and its modification and change times, to the
+//	nanosecond.  Nachos changes at least the mount count every run, so
+//	the stamp changes even if the run took less than a second.
+//----------------------------------------------------------------------
+
+static bool
+ImageStamp(char *stamp)
+{
+    JournalHeader header;
+    struct stat now;
+    off_t at = ImageMagicSize + (off_t) JournalSector * SectorSize;
+
+    if (fstat(imageFile, &now) != 0 ||
+        pread(imageFile, &header, sizeof(header), at) != sizeof(header))
+        return FALSE;
+    sprintf(stamp, "%d %lld.%09ld %lld.%09ld\n",
+            header.magic == JournalMagic ? header.generation : -1,
+            (long long) now.st_mtim.tv_sec, now.st_mtim.tv_nsec,
+            (long long) now.st_ctim.tv_sec, now.st_ctim.tv_nsec);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Unchanged/NoteClean
+// 	Keep track, in "<image>.fsck", of the stamp the image had when it
+//	was last found clean.
+//----------------------------------------------------------------------
+
+static bool
+Unchanged(char *stampName)
+{
+    FILE *stamp = fopen(stampName, "r");
+    char now[StampSize], then[StampSize];
+    bool same = FALSE;
+
+    if (stamp == NULL)
+        return FALSE;
+    if (fgets(then, StampSize, stamp) != NULL && ImageStamp(now))
+        same = (strcmp(then, now) == 0);
+    fclose(stamp);
+    return same;
+}
+
+static void
+NoteClean(char *stampName)
+{
+    char now[StampSize];
+    FILE *stamp;
+
+    if (!ImageStamp(now) || (stamp = fopen(stampName, "w")) == NULL)
+        return;
+    fputs(now, stamp);
+    fclose(stamp);
+}
+
+//----------------------------------------------------------------------
+// main
+// 	Check (and maybe repair) a Nachos disk image.
+//
+//	Usage: fsck [-r] [-f] [-j threads] [image]
+//	   -r  repair what can be repaired
+//	   -f  check even if the image is unchanged since it was last
+//	       found clean
+//	   -j  use this many host threads (default: one per processor)
+//----------------------------------------------------------------------
+
+int
+main(int argc, char **argv)
+{
+    bool force = FALSE;
+    struct stat info;
+    char *stampName;
+    int magic, c;
+    FileMap rootMap;
+    const char *problem;
+
+    numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    while ((c = getopt(argc, argv, "rfj:")) != -1) {
+        switch (c) {
+          case 'r':
+            repair = TRUE;
+            break;
+          case 'f':
+            force = TRUE;
+            break;
+          case 'j':
+            numThreads = atoi(optarg);
+            break;
+          default:
+            fprintf(stderr, "usage: %s [-r] [-f] [-j threads] [image]\n",
+                    argv[0]);
+            return ExitFailed;
+        }
+    }
+    if (optind < argc)
+        imageName = argv[optind];
+    numThreads = max(1, min(numThreads, MaxThreads));
+
+    imageFile = open(imageName, repair ? O_RDWR : O_RDONLY);
+    if (imageFile < 0 || fstat(imageFile, &info) != 0) {
+        perror(imageName);
+        return ExitFailed;
+    }
+    if (info.st_size != ImageSize ||
+        pread(imageFile, &magic, ImageMagicSize, 0) != ImageMagicSize ||
+        magic != ImageMagic) {
+        fprintf(stderr, "%s: not a Nachos disk image\n", imageName);
+        return ExitFailed;
+    }
+    stampName = new char[strlen(imageName) + 6];
+    sprintf(stampName, "%s.fsck", imageName);
+    if (!force && Unchanged(stampName)) {
+        printf("%s: clean, unchanged since the last check\n", imageName);
+        return ExitClean;
+    }
+
+    disk = new char[NumSectors * SectorSize];
+    changed = new bool[NumSectors];
+    owner = new int[NumSectors];
+    paths = new char *[NumSectors];
+    memset(changed, 0, NumSectors * sizeof(bool));
+    memset(owner, Unclaimed, NumSectors * sizeof(int));	// all ones
+    memset(paths, 0, NumSectors * sizeof(char *));
+    RunThreads(ReadSlice);
+    ReplayJournal();
+
+    // the journal, and the well-known headers, are always in use
+    for (int i = 0; i < JournalSectors; i++)
+        Claim(JournalSector + i, JournalOwner);
+    Claim(FreeMapSector, FreeMapSector);
+    Claim(DirectorySector, DirectorySector);
+    paths[FreeMapSector] = (char *) "(free map)";
+    paths[DirectorySector] = (char *) "/";
+
+    if ((problem = LoadFile(FreeMapSector, &mapFile)) != NULL ||
+        mapFile.numBytes < FreeMapFileSize) {
+        fprintf(stderr, "%s: free map header: %s\n", imageName,
+                problem ? problem : "file too short");
+        return ExitFailed;
+    }
+    ClaimData(&mapFile, FreeMapSector);
+    if ((problem = LoadFile(DirectorySector, &rootMap)) != NULL) {
+        fprintf(stderr, "%s: root directory header: %s\n", imageName,
+                problem);
+        return ExitFailed;
+    }
+    ClaimData(&rootMap, DirectorySector);
+
+    AddJob(DirectorySector, paths[DirectorySector]);
+    RunThreads(Walker);
+    ReportConflicts();
+    CheckFreeMap();
+
+    if (repair && !WriteChanges())
+        return ExitFailed;
+    if (numErrors == 0) {
+        printf("%s: clean\n", imageName);
+    } else {
+        printf("%s: %d problem%s found, %d fixed\n", imageName, numErrors,
+               numErrors == 1 ? "" : "s", numFixed);
+    }
+    if (numErrors == numFixed)
+        NoteClean(stampName);
+    return (numErrors == 0) ? ExitClean
+               : (numErrors == numFixed) ? ExitRepaired : ExitErrors;
+}
@@ -5,7 +5,18 @@
 //	the OpenFile data structure).
 //
 //	Also as in UNIX, for convenience, we keep the file header in
-//	memory while the file is open.
+//	memory while the file is open.  There is only one in-core copy
+//	of it however many times the file is open (see InodeTable), so
+//	every OpenFile sees the file at its current length.
+//
+//	Blocks of the file that have never been written read as zeros,
+//	without any disk I/O (see FileHeader::MarkWritten).
+//
+//	When a file is read sequentially, the blocks after the ones asked
+//	for are read ahead asynchronously, so that the next read finds
+//	them already in memory.  The read-ahead window starts small and
+//	doubles with every further sequential read, up to a track; a read
+//	anywhere else shuts it off until reads turn sequential again.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -18,26 +29,49 @@
 #include "openfile.h"
 #include "synchdisk.h"
 
+// Smallest and largest number of blocks read ahead at once.
+
+const int MinReadAhead = 4;
+const int MaxReadAhead = SectorsPerTrack;	// at most 32, see
+						// ReadAheadBuffer::used
+
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
 // 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+//	into memory while the file is open, unless another OpenFile
+//	already has.
 //
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
 
 OpenFile::OpenFile(int sector) {
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
+    inode = kernel->inodeTable->Get(sector);
     seekPosition = 0;
+    nextSequential = 0;
+    readAheadWindow = 0;
+    current = 0;
+    for (int i = 0; i < 2; i++) {
+        readAhead[i].first = -1;
+        readAhead[i].count = 0;
+        readAhead[i].data = new char[MaxReadAhead * SectorSize];
+        readAhead[i].request = NULL;
+    }
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	A read-ahead still in progress is waited for first.  The file
+//	header is written back when the last OpenFile on it is closed.
 //----------------------------------------------------------------------
 
-OpenFile::~OpenFile() { delete hdr; }
+OpenFile::~OpenFile() {
+    for (int i = 0; i < 2; i++) {
+        DropReadAhead(i);
+        delete[] readAhead[i].data;
+    }
+    kernel->inodeTable->Put(inode);
+}
 
 //----------------------------------------------------------------------
 // OpenFile::Seek
@@ -88,10 +122,28 @@ int OpenFile::Write(char *into, int numBytes) {
 //	   We read in all of the full or partial sectors that are part of the
 //	   request, but we only copy the part we are interested in.
 //	For WriteAt:
-//	   We must first read in any sectors that will be partially written,
+//	   If the write goes past the end of the file, we first grow the
+//	   file (or, if the disk is full, cut the write short at the end).
+//	   We must then read in any sectors that will be partially written,
 //	   so that we don't overwrite the unmodified portion.  We then copy
 //	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   or partial sectors that are part of the request.  A write of
+//	   whole sectors needs none of that: they go to disk straight
+//	   from the caller's buffer.
+//	   Any never-written blocks between the written part of the file
+//	   and the request are written with zeros first, so that the
+//	   written blocks always run from the start of the file.
+//
+//	The data of an inline file is in its header, already in memory:
+//	it is copied directly, and a write just marks the header dirty.
+//
+//	ReadAt also keeps track of whether the file is being read
+//	sequentially, and if so reads ahead of the caller.
+//
+//	Blocks of the file that sit in consecutive disk sectors are
+//	transferred together, with one multi-sector disk request.  WriteAt
+//	starts all of its multi-sector writes before waiting for any of
+//	them, so the disk can service them in whatever order is quickest.
 //
 //	"into" -- the buffer to contain the data to be read from disk
 //	"from" -- the buffer containing the data to be written to disk
@@ -101,8 +153,8 @@ int OpenFile::Write(char *into, int numBytes) {
 //----------------------------------------------------------------------
 
 int OpenFile::ReadAt(char *into, int numBytes, int position) {
-    int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
+    int fileLength = inode->hdr->FileLength();
+    int firstSector, lastSector, numSectors;
     char *buf; 
 
     //cout << "file length: " << fileLength << endl;
@@ -114,6 +166,11 @@ int OpenFile::ReadAt(char *into, int numBytes, int position) {
     DEBUG(dbgFile, "Reading " << numBytes << " bytes at " << position
                               << " from file of length " << fileLength);
 
+    if (inode->hdr->IsInline()) {
+        bcopy(inode->hdr->InlineData() + position, into, numBytes);
+        return numBytes;
+    }
+
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
 //	cout << "ReadAt " << firstSector << ' ' << lastSector << '\n';
@@ -121,65 +178,300 @@ int OpenFile::ReadAt(char *into, int numBytes, int position) {
 
     // read in all the full and partial sectors that we need
     buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)
-        kernel->synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize),
-                                      &buf[(i - firstSector) * SectorSize]);
+    ReadBlocks(firstSector, lastSector, buf);
 
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
     delete[] buf;
+
+    // grow the read-ahead window while reads stay sequential
+    if (position == nextSequential) {
+        readAheadWindow = (readAheadWindow == 0) ? MinReadAhead
+                              : min(2 * readAheadWindow, MaxReadAhead);
+    } else {
+        readAheadWindow = 0;
+    }
+    nextSequential = position + numBytes;
+    if (readAheadWindow > 0)
+        StartReadAhead(lastSector + 1);
     return numBytes;
 }
 
 int OpenFile::WriteAt(char *from, int numBytes, int position) {
-    int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
+    int fileLength = inode->hdr->FileLength();
+    int i, firstSector, lastSector, numSectors, sector, run, written;
+    int numPending = 0;
     bool firstAligned, lastAligned;
     char *buf;
+    DiskRequest **pending;
 
-    if ((numBytes <= 0) || (position >= fileLength))
+    if ((numBytes <= 0) || (position < 0))
         return 0; // check request
-    if ((position + numBytes) > fileLength)
-        numBytes = fileLength - position;
+    if ((position + numBytes) > fileLength) {
+        if (kernel->fileSystem->ExtendFile(inode, position + numBytes)) {
+            fileLength = inode->hdr->FileLength();
+        } else if (position >= fileLength) {
+            return 0; // disk full
+        } else {
+            numBytes = fileLength - position;
+        }
+    }
     DEBUG(dbgFile, "Writing " << numBytes << " bytes at " << position
                               << " from file of length " << fileLength);
 
+    if (inode->hdr->IsInline()) {
+        bcopy(from, inode->hdr->InlineData() + position, numBytes);
+        inode->dirty = TRUE;
+        return numBytes;
+    }
+
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
+    firstAligned = (position == (firstSector * SectorSize));
+    lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
 
-    buf = new char[numSectors * SectorSize];
+    // blocks read ahead that are about to change are no good any more
+    for (i = 0; i < 2; i++)
+        if (readAhead[i].first != -1 && readAhead[i].first <= lastSector &&
+            readAhead[i].first + readAhead[i].count > firstSector)
+            DropReadAhead(i);
 
-    // Mp4 mod tag
-    memset(buf, 0, sizeof(char) * numSectors *
-                       SectorSize); // dummy operation to keep valgrind happy
+    if (firstAligned && lastAligned) {
+        buf = from; // whole sectors: write them straight from "from"
+    } else {
+        buf = new char[numSectors * SectorSize];
 
-    firstAligned = (position == (firstSector * SectorSize));
-    lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
+        // Mp4 mod tag
+        memset(buf, 0, sizeof(char) * numSectors *
+                           SectorSize); // dummy operation to keep valgrind happy
+
+        // read in first and last sector, if they are to be partially
+        // modified
+        if (!firstAligned)
+            ReadBlocks(firstSector, firstSector, buf);
+        if (!lastAligned && ((firstSector != lastSector) || firstAligned))
+            ReadBlocks(lastSector, lastSector,
+                       &buf[(lastSector - firstSector) * SectorSize]);
 
-    // read in first and last sector, if they are to be partially modified
-    if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);
-    if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize], SectorSize,
-               lastSector * SectorSize);
+        // copy in the bytes we want to change
+        bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
+    }
 
-    // copy in the bytes we want to change
-    bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
+    // fill in the gap, if any, after the blocks written so far
+    written = inode->hdr->WrittenSectors();
+    if (firstSector > written)
+        ZeroBlocks(written, firstSector - 1);
 
     // write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)
-        kernel->synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize),
-                                       &buf[(i - firstSector) * SectorSize]);
-    delete[] buf;
+    pending = new DiskRequest *[numSectors];
+    for (i = firstSector; i <= lastSector; i += run) {
+        run = SectorRun(i, lastSector, &sector);
+        if (run == 1)
+            kernel->synchDisk->WriteSector(
+                sector, &buf[(i - firstSector) * SectorSize]);
+        else
+            pending[numPending++] = kernel->synchDisk->WriteAsync(
+                sector, run, &buf[(i - firstSector) * SectorSize]);
+    }
+    for (i = 0; i < numPending; i++)
+        kernel->synchDisk->Wait(pending[i]);
+    if (inode->hdr->MarkWritten(lastSector + 1))
+        inode->dirty = TRUE;
+    delete[] pending;
+    if (buf != from)
+        delete[] buf;
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::SectorRun
+// 	Return how many file blocks, starting at block "first" and going
+//	no further than block "last", are stored in consecutive disk
+//	sectors.  "sector" is set to the disk sector of block "first".
+//----------------------------------------------------------------------
+
+int OpenFile::SectorRun(int first, int last, int *sector) {
+    int run = 1;
+
+    *sector = inode->hdr->ByteToSector(first * SectorSize);
+    while (first + run <= last &&
+           inode->hdr->ByteToSector((first + run) * SectorSize) == *sector + run)
+        run++;
+    return run;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadBlocks
+// 	Read file blocks "first" through "last" into a buffer.  Blocks
+//	never written are zeros; blocks that have been read ahead are
+//	copied from the read-ahead buffers; the rest are read in runs of
+//	consecutive disk sectors.
+//----------------------------------------------------------------------
+
+void OpenFile::ReadBlocks(int first, int last, char *into) {
+    int written = inode->hdr->WrittenSectors();
+    int i, j, sector, run;
+
+    if (last >= written) {
+        i = max(first, written);
+        memset(&into[(i - first) * SectorSize], 0,
+               (last - i + 1) * SectorSize);
+        last = i - 1;
+    }
+
+    for (i = first; i <= last; i += run) {
+        if (TakeReadAhead(i, &into[(i - first) * SectorSize])) {
+            run = 1;
+            continue;
+        }
+        run = SectorRun(i, last, &sector);
+        for (j = 1; j < run; j++)
+            if (ReadAheadHolds(i + j)) {
+                run = j;
+                break;
+            }
+        kernel->synchDisk->ReadSectors(sector, run,
+                                       &into[(i - first) * SectorSize]);
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ZeroBlocks
+// 	Write zeros to file blocks "first" through "last", in runs of
+//	consecutive disk sectors.
+//----------------------------------------------------------------------
+
+void OpenFile::ZeroBlocks(int first, int last) {
+    char *zeros = new char[SectorsPerTrack * SectorSize];
+    int i, sector, run;
+
+    memset(zeros, 0, SectorsPerTrack * SectorSize);
+    for (i = first; i <= last; i += run) {
+        run = SectorRun(i, min(last, i + SectorsPerTrack - 1), &sector);
+        kernel->synchDisk->WriteSectors(sector, run, zeros);
+    }
+    delete[] zeros;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadAheadHolds
+// 	Return TRUE if file block "block" is in one of the read-ahead
+//	buffers (whether or not the read has completed).
+//----------------------------------------------------------------------
+
+bool OpenFile::ReadAheadHolds(int block) {
+    for (int i = 0; i < 2; i++)
+        if (readAhead[i].first != -1 && block >= readAhead[i].first &&
+            block < readAhead[i].first + readAhead[i].count)
+            return TRUE;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::TakeReadAhead
+// 	If file block "block" has been read ahead, copy it into "into" and
+//	return TRUE.  Wait for the read to complete if need be.
+//
+//	Once any write has been sent to the disk since a buffer was read,
+//	the buffer is thrown away, as it may be stale; copies of its
+//	sectors that are in the disk cache are newer, and are used instead.
+//
+//	Reaching the next window read ahead means the reader is done with
+//	the current one, so the current one is freed for reading further
+//	ahead.
+//----------------------------------------------------------------------
+
+bool OpenFile::TakeReadAhead(int block, char *into) {
+    for (int i = 0; i < 2; i++) {
+        ReadAheadBuffer *buffer = &readAhead[i];
+        int offset = block - buffer->first;
+
+        if (buffer->first == -1 || offset < 0 || offset >= buffer->count)
+            continue;
+        if (buffer->request != NULL) {
+            kernel->synchDisk->Wait(buffer->request);
+            buffer->request = NULL;
+        }
+        if (buffer->writeStamp != kernel->synchDisk->WriteCount()) {
+            DropReadAhead(i);
+            return FALSE;
+        }
+        kernel->synchDisk->CopyCached(buffer->sector + offset, 1,
+                                      &buffer->data[offset * SectorSize]);
+        bcopy(&buffer->data[offset * SectorSize], into, SectorSize);
+        if (!(buffer->used & (1 << offset))) {
+            buffer->used |= 1 << offset;
+            kernel->stats->numReadAheadHits++;
+        }
+        if (i != current) {
+            DropReadAhead(current);
+            current = i;
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::StartReadAhead
+// 	Start reading up to readAheadWindow blocks, from "block" on (or
+//	past the blocks already read ahead), into the read-ahead buffer
+//	that is not being consumed.  Nothing is done if that buffer is
+//	still in use, or the end of the file's written blocks has been
+//	reached.  Only blocks in consecutive disk sectors are read, with
+//	one request.
+//----------------------------------------------------------------------
+
+void OpenFile::StartReadAhead(int block) {
+    int numBlocks = min(divRoundUp(inode->hdr->FileLength(), SectorSize),
+                        inode->hdr->WrittenSectors());
+    ReadAheadBuffer *buffer = &readAhead[1 - current];
+    int last;
+
+    while (ReadAheadHolds(block))
+        block++;
+    if (buffer->first != -1 || block >= numBlocks)
+        return;
+    last = min(block + readAheadWindow, numBlocks) - 1;
+    buffer->first = block;
+    buffer->count = SectorRun(block, last, &buffer->sector);
+    buffer->writeStamp = kernel->synchDisk->WriteCount();
+    buffer->used = 0;
+    buffer->request = kernel->synchDisk->ReadAsync(
+        buffer->sector, buffer->count, buffer->data);
+    kernel->stats->numReadAheadSectors += buffer->count;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::DropReadAhead
+// 	Empty read-ahead buffer "which", first waiting for its read to
+//	complete if it is still in progress.
+//----------------------------------------------------------------------
+
+void OpenFile::DropReadAhead(int which) {
+    ReadAheadBuffer *buffer = &readAhead[which];
+
+    if (buffer->request != NULL)
+        kernel->synchDisk->Wait(buffer->request);
+    buffer->request = NULL;
+    buffer->first = -1;
+    buffer->count = 0;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
 // 	Return the number of bytes in the file.
 //----------------------------------------------------------------------
 
-int OpenFile::Length() { return hdr->FileLength(); }
+int OpenFile::Length() { return inode->hdr->FileLength(); }
+
+//----------------------------------------------------------------------
+// OpenFile::HeaderSector
+// 	Return the disk sector holding the file header, which is what
+//	identifies the file while it exists.
+//----------------------------------------------------------------------
+
+int OpenFile::HeaderSector() { return inode->sector; }
 
 #endif // FILESYS_STUB
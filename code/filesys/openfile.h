@@ -60,7 +60,24 @@ class OpenFile {
 };
 
 #else // FILESYS
-class FileHeader;
+class Inode;
+class DiskRequest;
+
+// The following class defines a buffer of file blocks read ahead of
+// a sequential reader.  The blocks sit in consecutive disk sectors and
+// are read with one asynchronous request.
+
+class ReadAheadBuffer {
+  public:
+    int first;				// first file block held, -1 if empty
+    int count;				// number of blocks held
+    int sector;				// disk sector of block "first"
+    char *data;				// contents of the blocks
+    DiskRequest *request;		// read still to be collected, or NULL
+    int writeStamp;			// disk write count when read started
+    unsigned int used;			// bit i set once block first+i
+					// has been handed to a reader
+};
 
 class OpenFile {
   public:
@@ -86,10 +103,39 @@ class OpenFile {
 					// file (this interface is simpler 
 					// than the UNIX idiom -- lseek to 
 					// end of file, tell, lseek back 
+
+    int HeaderSector();			// Disk sector holding the header,
+					// which identifies the file
     
   private:
-    FileHeader *hdr;			// Header for this file 
+    Inode *inode;			// In-core header for this file,
+					// shared with every other OpenFile
+					// on it
     int seekPosition;			// Current position within the file
+
+    int nextSequential;			// Position a sequential ReadAt
+					// would start from
+    int readAheadWindow;		// # blocks to read ahead, 0 while
+					// access looks random
+    ReadAheadBuffer readAhead[2];	// Blocks being consumed, and the
+					// next window read ahead of them
+    int current;			// Index of the one being consumed
+
+    int SectorRun(int first, int last, int *sector);
+					// Find the disk sector of file block
+					// "first", and how many of the blocks
+					// up to "last" follow it on disk
+    void ReadBlocks(int first, int last, char *into);
+					// Read file blocks "first" to "last"
+    void ZeroBlocks(int first, int last);
+					// Write zeros to blocks "first" to
+					// "last"
+    bool ReadAheadHolds(int block);	// Is the block read ahead?
+    bool TakeReadAhead(int block, char *into);
+					// Copy a block out of the read-ahead
+					// buffers, if it is there
+    void StartReadAhead(int block);	// Read ahead starting at "block"
+    void DropReadAhead(int which);	// Empty a read-ahead buffer
 };
 
 #endif // FILESYS
@@ -2,12 +2,17 @@
 //	Routines to manage a persistent bitmap -- a bitmap that is
 //	stored on disk.
 //
+//	To keep WriteBack cheap on a large bitmap, we track which
+//	SectorSize pieces of the bitmap have been modified, and only
+//	write those pieces back.
+//
 // Copyright (c) 1992,1993,1995 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
 #include "pbitmap.h"
+#include "disk.h"
 
 //----------------------------------------------------------------------
 // PersistentBitmap::PersistentBitmap(int)
@@ -16,11 +21,15 @@
 //
 //	"numItems" is the number of bits in the bitmap.
 //
-//      This constructor does not initialize the bitmap from a disk file
+//      This constructor does not initialize the bitmap from a disk file,
+//	so every sector is considered dirty.
 //----------------------------------------------------------------------
 
 PersistentBitmap::PersistentBitmap(int numItems):Bitmap(numItems) 
 { 
+    numSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numSectors];
+    SetAllDirty(TRUE);
 }
 
 //----------------------------------------------------------------------
@@ -37,10 +46,13 @@ PersistentBitmap::PersistentBitmap(int numItems):Bitmap(numItems)
 
 PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems) 
 { 
+    numSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numSectors];
+
     // map has already been initialized by the BitMap constructor,
     // but we will just overwrite that with the contents of the
     // map found in the file
-    file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    FetchFrom(file);
 }
 
 //----------------------------------------------------------------------
@@ -50,6 +62,29 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems
 
 PersistentBitmap::~PersistentBitmap()
 { 
+    delete [] dirty;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Mark/Clear
+// 	Set or clear the "nth" bit, and note that the sector of the
+//	bitmap file holding it needs to be written back.
+//
+//	"which" is the number of the bit to be set/cleared.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Mark(int which)
+{
+    Bitmap::Mark(which);
+    dirty[which / (SectorSize * BitsInByte)] = TRUE;
+}
+
+void
+PersistentBitmap::Clear(int which)
+{
+    Bitmap::Clear(which);
+    dirty[which / (SectorSize * BitsInByte)] = TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -63,11 +98,13 @@ void
 PersistentBitmap::FetchFrom(OpenFile *file) 
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    CountClear();
+    SetAllDirty(FALSE);
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::WriteBack
-// 	Store the contents of a persistent bitmap to a Nachos file.
+// 	Store the modified sectors of a persistent bitmap to a Nachos file.
 //
 //	"file" is the place to write the bitmap to
 //----------------------------------------------------------------------
@@ -75,5 +112,28 @@ PersistentBitmap::FetchFrom(OpenFile *file)
 void
 PersistentBitmap::WriteBack(OpenFile *file)
 {
-   file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    int mapSize = numWords * sizeof(unsigned);
+
+    for (int i = 0; i < numSectors; i++) {
+        if (dirty[i]) {
+            int offset = i * SectorSize;
+            int numBytes = min(SectorSize, mapSize - offset);
+
+            file->WriteAt((char *)map + offset, numBytes, offset);
+            dirty[i] = FALSE;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::SetAllDirty
+// 	Mark every sector of the bitmap as dirty, or as clean.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::SetAllDirty(bool isDirty)
+{
+    for (int i = 0; i < numSectors; i++) {
+        dirty[i] = isDirty;
+    }
 }
@@ -20,6 +20,10 @@
 // The following class defines a persistent bitmap.  It inherits all
 // the behavior of a bitmap (see bitmap.h), adding the ability to
 // be read from and stored to the disk.
+//
+// The bitmap remembers which sectors of its on-disk image have been
+// changed by Mark or Clear since it was last fetched or written, so
+// that WriteBack only has to write those sectors.
 
 class PersistentBitmap : public Bitmap {
   public:
@@ -28,8 +32,19 @@ class PersistentBitmap : public Bitmap {
 
     ~PersistentBitmap(); 			// deallocate bitmap
 
+    void Mark(int which);   		// Set/clear the "nth" bit, and
+    void Clear(int which);  		// remember its sector is dirty
+
     void FetchFrom(OpenFile *file);     // read bitmap from the disk
-    void WriteBack(OpenFile *file); 	// write bitmap contents to disk 
+    void WriteBack(OpenFile *file); 	// write dirty sectors of the
+					// bitmap contents to disk 
+
+  private:
+    int numSectors;			// # of sectors in the on-disk image
+    bool *dirty;			// dirty[i] -- has sector i of the
+					// image changed since last sync?
+
+    void SetAllDirty(bool isDirty);	// mark every sector (not) dirty
 };
 
 #endif // PBITMAP_H
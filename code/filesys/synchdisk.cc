@@ -5,10 +5,66 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	Each request carries a semaphore that the interrupt handler
+//	signals when the request is done.  The physical disk can only
+//	handle one operation at a time, so requests that arrive while it
+//	is busy wait in a queue; when a request completes, the interrupt
+//	handler starts the next one.  Which request goes next is up to the
+//	scheduling policy: first come first served, shortest seek first,
+//	SCAN (sweep up and down the disk), or C-LOOK (sweep up, then jump
+//	back to the lowest request).  The queue is only touched with
+//	interrupts disabled, since the interrupt handler uses it too.
+//
+//	Recently used sectors are kept in a write-back cache, managed
+//	in LRU order.  A read that hits in the cache costs no disk time;
+//	a write only marks the cached copy dirty, and the sector is
+//	written to disk when its slot is recycled, or on Flush.  A lock
+//	protects the cache, but it is released while a thread waits for
+//	the disk so that other threads can queue their own requests; a
+//	slot whose contents are in transit is marked busy meanwhile, and
+//	other threads wanting it wait until it is free again.
+//
+//	Asynchronous requests go through the same queue, but the caller
+//	does not wait for them.  They bypass the cache: a write updates
+//	any cached copies before it is queued, and a read is patched up
+//	from the cache when the caller collects it with Wait.
+//
+//	Runs of consecutive sectors can be transferred with a single disk
+//	request.  A read takes cached sectors from the cache and reads the
+//	rest straight into the caller's buffer; the sectors read are only
+//	added to the cache if the run fits in a track, so that streaming
+//	through a large file does not wipe out the cache.  A write goes to
+//	disk at once, refreshing any cached copies on the way.
+//
+//	The file system can open a journal, a run of sectors where the
+//	sectors written by its operations are logged before they may go
+//	home.  Such writes all go through the cache, where they stay
+//	pinned until the transaction holding them is committed: one
+//	sequential write of a descriptor and the sectors, at the tail of
+//	the log.  A transaction groups all operations since the last
+//	commit, and is committed when it gets big or old, or on Flush.
+//	When the journal is opened, committed transactions are replayed,
+//	so that after a crash every operation is either wholly on disk or
+//	not at all.
+//
+//	A committed sector is not written home when its slot is recycled:
+//	the log has it, and an in-memory map (logMap) says where, so that
+//	reads can find it there.  Sectors go home only when the log is
+//	cleaned, by a background thread, once half of the log is in use:
+//	it reads everything logged so far in one sweep, writes the newest
+//	copy of each sector home in increasing sector order, coalescing
+//	neighbours into one request, and then moves the head of the log
+//	past it.  Commits carry on meanwhile, into the rest of the log.
+//
+//	As long as a sector is in the log, every write to it is logged,
+//	whoever makes it; otherwise replaying an old copy from the log
+//	could undo a later write.
+//
+//	A disk formatted for data journaling logs every write, file data
+//	too, not just those of file system operations.  Every sector is
+//	then written twice, but small scattered writes all become
+//	sequential appends to the log, and reach their homes in sorted
+//	batches.  Files still live in place; the log is not their home.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -16,33 +72,127 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "main.h"
+
+// Names of the scheduling policies, as reported in the statistics.
+
+static char *policyNames[] = { "FCFS", "SSTF", "SCAN", "C-LOOK" };
+
+//----------------------------------------------------------------------
+// LogCopyKey, LogCopyHash
+// 	Key of an entry in the log map -- the home sector -- and the hash
+//	of a key.
+//----------------------------------------------------------------------
+
+static int LogCopyKey(LogCopy *copy) { return copy->sector; }
 
+static unsigned LogCopyHash(int sector) { return (unsigned) sector; }
+
+//----------------------------------------------------------------------
+// CompareLogCopies
+// 	Order log map entries by home sector, for qsort.
+//----------------------------------------------------------------------
+
+static int
+CompareLogCopies(const void *a, const void *b)
+{
+    return ((LogCopy *) a)->sector - ((LogCopy *) b)->sector;
+}
+
+//----------------------------------------------------------------------
+// LogCleaner
+// 	Start the log cleaner thread of "disk".
+//----------------------------------------------------------------------
+
+static void
+LogCleaner(SynchDisk *disk)
+{
+    disk->RunCleaner();
+}
 
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
 // 	Initialize the synchronous interface to the physical disk, in turn
 //	initializing the physical disk.
 //
+//	"cacheSize" -- number of sectors to cache, 0 for no caching
+//	"policy" -- how to order requests waiting for the disk
+//	"mapDisk" -- map the disk's UNIX file into memory (see Disk)
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk()
+SynchDisk::SynchDisk(int cacheSize, DiskSchedPolicy policy, bool mapDisk)
 {
-    semaphore = new Semaphore("synch disk", 0);
+    ASSERT(cacheSize >= 0);
     lock = new Lock("synch disk lock");
-    disk = new Disk(this);
+    slotFree = new Condition("synch disk slot free");
+    disk = new Disk(this, mapDisk);
+
+    this->policy = policy;
+    queue = new List<DiskRequest *>;
+    current = NULL;
+    headSector = 0;
+    sweepUp = TRUE;
+    numWrites = 0;
+    kernel->stats->diskPolicy = policyNames[policy];
+
+    journalStart = -1;
+    logAll = FALSE;
+    opThreads = new List<Thread *>;
+    numPinned = maxPinned = 0;
+    logMap = NULL;
+    cleanWanted = new Condition("synch disk clean wanted");
+    logSpace = new Condition("synch disk log space");
+    cleaning = FALSE;
+
+    this->cacheSize = cacheSize;
+    cache = NULL;
+    hashHeads = NULL;
+    lruHead = lruTail = -1;
+    if (cacheSize > 0) {
+        cache = new CacheEntry[cacheSize];
+        hashHeads = new int[cacheSize];
+        for (int i = 0; i < cacheSize; i++) {
+            cache[i].sector = -1;
+            cache[i].dirty = FALSE;
+            cache[i].busy = FALSE;
+            cache[i].hashNext = -1;
+            cache[i].pinned = FALSE;
+            cache[i].prev = i - 1;
+            cache[i].next = (i + 1 < cacheSize) ? i + 1 : -1;
+            hashHeads[i] = -1;
+        }
+        lruHead = 0;
+        lruTail = cacheSize - 1;
+    }
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::~SynchDisk
 // 	De-allocate data structures needed for the synchronous disk
-//	abstraction.
+//	abstraction.  Dirty sectors must already have been written back
+//	with Flush.
 //----------------------------------------------------------------------
 
 SynchDisk::~SynchDisk()
 {
+    ASSERT(current == NULL && queue->IsEmpty());
+    delete [] cache;
+    delete [] hashHeads;
+    delete queue;
     delete disk;
+    delete slotFree;
     delete lock;
-    delete semaphore;
+    delete opThreads;
+    delete cleanWanted;
+    delete logSpace;
+    if (logMap != NULL) {
+        while (!logMap->IsEmpty()) {
+            HashIterator<int, LogCopy *> iter(logMap);
+
+            delete logMap->Remove(iter.Item()->sector);
+        }
+        delete logMap;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -57,16 +207,44 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
+    int slot;
+
+    if (cacheSize == 0) {
+        DiskRead(sectorNumber, data);
+        return;
+    }
+    lock->Acquire();
+    for (;;) {
+        slot = WaitForSlot(sectorNumber);
+        if (slot != -1) {
+            kernel->stats->numCacheHits++;
+            break;
+        }
+        slot = GetSlot(sectorNumber);
+        if (slot == -1) {
+            continue;			// cache changed, look again
+        }
+        kernel->stats->numCacheMisses++;
+        cache[slot].busy = TRUE;
+        lock->Release();
+        ReadHome(sectorNumber, cache[slot].data);
+        lock->Acquire();
+        cache[slot].busy = FALSE;
+        slotFree->Broadcast(lock);
+        break;
+    }
+    Touch(slot);
+    bcopy(cache[slot].data, data, SectorSize);
     lock->Release();
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::WriteSector
 // 	Write the contents of a buffer into a disk sector.  Return only
-//	after the data has been written.
+//	after the data has been written.  With the cache enabled, the
+//	data is only copied into the cache; it reaches the disk later.
+//	A write that must be journaled pins the slot; if that fills the
+//	transaction, it is committed.
 //
 //	"sectorNumber" -- the disk sector to be written
 //	"data" -- the new contents of the disk sector
@@ -75,20 +253,1284 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
+    int slot;
+    bool full;
+
+    if (cacheSize == 0) {
+        DiskWrite(sectorNumber, data);
+        return;
+    }
+    lock->Acquire();
+    for (;;) {
+        slot = WaitForSlot(sectorNumber);
+        if (slot != -1) {
+            kernel->stats->numCacheHits++;
+            break;
+        }
+        slot = GetSlot(sectorNumber);	// whole sector is overwritten,
+					// so no need to read it first
+        if (slot != -1) {
+            kernel->stats->numCacheMisses++;
+            break;
+        }
+    }
+    Touch(slot);
+    bcopy(data, cache[slot].data, SectorSize);
+    cache[slot].dirty = TRUE;
+    if (Journaled(sectorNumber, 1)) {
+        Pin(slot);
+    }
+    full = (journalStart != -1 && numPinned >= maxPinned);
+    lock->Release();
+    if (full) {
+        Commit();
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors
+// 	Read "numSectors" consecutive sectors into a buffer.  Sectors that
+//	are cached are copied from the cache (they may be newer than the
+//	disk); each run of uncached sectors is read with one request, and
+//	cached afterwards if it is no longer than a track.
+//
+//	Once any write has been sent to the disk since a run was read, no
+//	more of the run is cached: the data read may be out of date.
+//
+//	"sectorNumber" -- the first disk sector to read
+//	"numSectors" -- the number of sectors to read
+//	"data" -- the buffer to hold the contents of the sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadSectors(int sectorNumber, int numSectors, char* data)
+{
+    int i = 0;
+
+    if (cacheSize == 0) {
+        DiskRead(sectorNumber, data, numSectors);
+        return;
+    }
+    lock->Acquire();
+    while (i < numSectors) {
+        int slot = WaitForSlot(sectorNumber + i);
+        int run = 0;
+        int writesBefore;
+
+        if (slot != -1) {
+            kernel->stats->numCacheHits++;
+            Touch(slot);
+            bcopy(cache[slot].data, &data[i * SectorSize], SectorSize);
+            i++;
+            continue;
+        }
+        while (i + run < numSectors && Lookup(sectorNumber + i + run) == -1) {
+            run++;
+        }
+        kernel->stats->numCacheMisses += run;
+        writesBefore = numWrites;
+        lock->Release();
+        ReadHome(sectorNumber + i, &data[i * SectorSize], run);
+        lock->Acquire();
+        for (int j = 0; run <= SectorsPerTrack && j < run; j++) {
+            if (numWrites != writesBefore) {
+                break;			// what we read may be stale
+            }
+            Install(sectorNumber + i + j, &data[(i + j) * SectorSize]);
+        }
+        i += run;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteSectors
+// 	Write "numSectors" consecutive sectors from a buffer to disk, in
+//	one request.  Cached copies of the sectors are updated, and are
+//	clean afterwards.  They are kept busy until the write is done, so
+//	that nobody can write an older copy over them in the meantime.
+//
+//	Sectors that must be journaled are written into the cache one at
+//	a time instead, to be logged.
+//
+//	"sectorNumber" -- the first disk sector to write
+//	"numSectors" -- the number of sectors to write
+//	"data" -- the new contents of the sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteSectors(int sectorNumber, int numSectors, char* data)
+{
+    int i, slot;
+
+    if (cacheSize == 0) {
+        DiskWrite(sectorNumber, data, numSectors);
+        return;
+    }
+    lock->Acquire();
+    if (Journaled(sectorNumber, numSectors)) {
+        lock->Release();
+        for (i = 0; i < numSectors; i++) {
+            WriteSector(sectorNumber + i, &data[i * SectorSize]);
+        }
+        return;
+    }
+    for (i = 0; i < numSectors; i++) {	// wait until none is busy
+        slot = Lookup(sectorNumber + i);
+        if (slot != -1 && cache[slot].busy) {
+            slotFree->Wait(lock);
+            i = -1;
+        }
+    }
+    for (i = 0; i < numSectors; i++) {
+        slot = Lookup(sectorNumber + i);
+        if (slot != -1) {
+            bcopy(&data[i * SectorSize], cache[slot].data, SectorSize);
+            cache[slot].dirty = FALSE;
+            cache[slot].busy = TRUE;
+        }
+    }
+    lock->Release();
+    DiskWrite(sectorNumber, data, numSectors);
+    lock->Acquire();
+    for (i = 0; i < numSectors; i++) {
+        slot = Lookup(sectorNumber + i);
+        if (slot != -1) {
+            cache[slot].busy = FALSE;
+        }
+    }
+    slotFree->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadAsync
+// 	Start reading "numSectors" consecutive sectors into a buffer, and
+//	return without waiting for the data.  The buffer must not be
+//	touched until the request has been passed to Wait, which also
+//	copies in any cached sectors that are newer than the disk.
+//
+//	"sectorNumber" -- the first disk sector to read
+//	"numSectors" -- the number of sectors to read
+//	"data" -- the buffer to hold the contents of the sectors
+//	"toCall" -- if not NULL, called from the interrupt handler when
+//		the disk is done
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::ReadAsync(int sectorNumber, int numSectors, char* data,
+                     CallBackObj *toCall)
+{
+    DiskRequest *request = new DiskRequest;
+
+    request->sector = sectorNumber;
+    request->numSectors = numSectors;
+    request->data = data;
+    request->writing = FALSE;
+    request->done = new Semaphore("synch disk async request", 0);
+    request->callWhenDone = toCall;
+    request->finished = FALSE;
+    request->slots = NULL;
+    Submit(request);
+    return request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteAsync
+// 	Start writing "numSectors" consecutive sectors from a buffer, and
+//	return without waiting for the disk.  The buffer must not be
+//	changed until the request has been passed to Wait.
+//
+//	Cached copies of the sectors are updated first, and marked clean
+//	and busy until the request is passed to Wait, as in WriteSectors,
+//	so no other write of them can reach the disk ahead of this one.
+//
+//	Sectors that must be journaled are written into the cache instead,
+//	as by WriteSectors, and the request is returned already done.
+//
+//	"sectorNumber" -- the first disk sector to write
+//	"numSectors" -- the number of sectors to write
+//	"data" -- the new contents of the sectors
+//	"toCall" -- if not NULL, called from the interrupt handler when
+//		the disk is done
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::WriteAsync(int sectorNumber, int numSectors, char* data,
+                      CallBackObj *toCall)
+{
+    DiskRequest *request = new DiskRequest;
+    bool journaled = FALSE;
+    int i, slot;
+
+    request->slots = NULL;
+    if (cacheSize > 0) {
+        lock->Acquire();
+        journaled = Journaled(sectorNumber, numSectors);
+        for (i = 0; !journaled && i < numSectors; i++) {
+            slot = Lookup(sectorNumber + i);	// wait until none is busy
+            if (slot != -1 && cache[slot].busy) {
+                slotFree->Wait(lock);
+                i = -1;
+            }
+        }
+        if (!journaled) {
+            request->slots = new int[numSectors];
+            for (i = 0; i < numSectors; i++) {
+                slot = Lookup(sectorNumber + i);
+                if (slot != -1) {
+                    bcopy(&data[i * SectorSize], cache[slot].data,
+                          SectorSize);
+                    cache[slot].dirty = FALSE;
+                    cache[slot].busy = TRUE;
+                }
+                request->slots[i] = slot;
+            }
+        }
+        lock->Release();
+    }
+    request->sector = sectorNumber;
+    request->numSectors = numSectors;
+    request->data = data;
+    request->writing = TRUE;
+    request->done = new Semaphore("synch disk async request", 0);
+    request->callWhenDone = toCall;
+    request->finished = FALSE;
+    if (journaled) {
+        for (i = 0; i < numSectors; i++) {
+            WriteSector(sectorNumber + i, &data[i * SectorSize]);
+        }
+        request->finished = TRUE;
+        if (toCall != NULL) {
+            toCall->CallBack();
+        }
+        request->done->V();
+        return request;
+    }
+    numWrites++;
+    Submit(request);
+    return request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Poll
+// 	Return TRUE if an asynchronous request has completed, so that
+//	Wait will not block.
+//----------------------------------------------------------------------
+
+bool
+SynchDisk::Poll(DiskRequest *request)
+{
+    return request->finished;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Wait
+// 	Wait for an asynchronous request to complete, then free it.  For
+//	a read, sectors that are in the log or cached replace what was
+//	read from disk, as those copies may be newer.  For a write, the
+//	cached copies WriteAsync marked busy are let go.
+//
+//	"request" -- a handle returned by ReadAsync or WriteAsync
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Wait(DiskRequest *request)
+{
+    request->done->P();
+    if (!request->writing) {
+        if (logMap != NULL) {
+            lock->Acquire();
+            ReadLogged(request->sector, request->numSectors, request->data);
+            lock->Release();
+        }
+        CopyCached(request->sector, request->numSectors, request->data);
+    } else if (request->slots != NULL) {
+        lock->Acquire();
+        for (int i = 0; i < request->numSectors; i++) {
+            if (request->slots[i] != -1) {
+                cache[request->slots[i]].busy = FALSE;
+            }
+        }
+        slotFree->Broadcast(lock);
+        lock->Release();
+        delete [] request->slots;
+    }
+    delete request->done;
+    delete request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::CopyCached
+// 	Copy those sectors of a run that are in the cache over the
+//	corresponding parts of a buffer holding the run, so that data
+//	read from disk some time ago picks up any newer cached copies.
+//
+//	"sectorNumber" -- the first sector of the run
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- the contents of the run
+//----------------------------------------------------------------------
+
+void
+SynchDisk::CopyCached(int sectorNumber, int numSectors, char* data)
+{
+    if (cacheSize == 0) {
+        return;
+    }
+    lock->Acquire();
+    for (int i = 0; i < numSectors; i++) {
+        int slot = WaitForSlot(sectorNumber + i);
+
+        if (slot != -1) {
+            bcopy(cache[slot].data, &data[i * SectorSize], SectorSize);
+        }
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush
+// 	Write every dirty sector in the cache back to disk, in increasing
+//	sector order so the head sweeps across the disk once.  The
+//	sectors stay cached (clean).
+//
+//	With a journal, the open transaction is committed first, and the
+//	sectors in the log are left to Clean, which writes them home from
+//	there and empties the log.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Flush()
+{
+    Commit();
+    lock->Acquire();
+    for (;;) {
+        int next = -1;
+        for (int i = 0; i < cacheSize; i++) {
+            if (cache[i].dirty && !cache[i].busy && !cache[i].pinned &&
+                !IsLogged(cache[i].sector) &&
+                (next == -1 || cache[i].sector < cache[next].sector)) {
+                next = i;
+            }
+        }
+        if (next == -1) {
+            break;
+        }
+        cache[next].busy = TRUE;
+        lock->Release();
+        DiskWrite(cache[next].sector, cache[next].data);
+        lock->Acquire();
+        cache[next].dirty = FALSE;
+        cache[next].busy = FALSE;
+        slotFree->Broadcast(lock);
+    }
+    if (journalStart != -1) {
+        Clean();
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::OpenJournal
+// 	Start logging file system operations in the journal occupying
+//	"numSectors" sectors from "firstSector" on, and start the thread
+//	that cleans it.  Unless the disk is being formatted, first replay
+//	the transactions committed to the log, in order, up to the first
+//	record that is missing or incomplete; they may not all have
+//	reached home before the last shutdown.  Either way the log is
+//	then empty.  The mount count in the journal header goes up by one.
+//
+//	When formatting, records left in the log by an earlier file
+//	system are looked over, so that new records are numbered after
+//	them and none of them can be mistaken for a new one.
+//
+//	A transaction lives in the cache until it is committed, so there
+//	is no journaling without a cache (but the journal is still
+//	replayed).
+//
+//	"firstSector" -- the first sector of the journal
+//	"numSectors" -- the number of sectors in the journal
+//	"format" -- is the disk being formatted?
+//	"logAll" -- when formatting, log every write from now on
+//----------------------------------------------------------------------
+
+void
+SynchDisk::OpenJournal(int firstSector, int numSectors, bool format,
+                       bool logAll)
+{
+    char buf[SectorSize];
+    JournalHeader *header = (JournalHeader *) buf;
+    JournalRecord *record = (JournalRecord *) buf;
+    int pos = firstSector + 1;
+    int replayed = 0;
+    char *data;
+
+    ASSERT(sizeof(JournalHeader) <= SectorSize);
+    ASSERT(sizeof(JournalRecord) <= SectorSize);
+    journalStart = firstSector;
+    journalSize = numSectors;
+    journalSeq = 0;
+    journalGeneration = 0;
+    if (format) {
+        this->logAll = logAll;
+        data = new char[(numSectors - 1) * SectorSize];
+        DiskRead(pos, data, numSectors - 1);
+        for (int i = 0; i < numSectors - 1; i++) {
+            JournalRecord *old = (JournalRecord *) &data[i * SectorSize];
+
+            if (old->magic == JournalMagic && old->seq >= journalSeq) {
+                journalSeq = old->seq + 1;
+            }
+        }
+        delete [] data;
+    } else {
+        DiskRead(firstSector, buf);
+        if (header->magic == JournalMagic) {
+            journalSeq = header->seq;
+            journalGeneration = header->generation + 1;
+            this->logAll = (header->flags & JournalLogAll) != 0;
+            if (header->head > firstSector &&
+                header->head <= firstSector + numSectors) {
+                pos = header->head;
+            }
+        }
+        while ((data = ReadRecord(&pos, buf)) != NULL) {
+            for (int i = 0; i < record->count; i++) {
+                DiskWrite(record->home[i], &data[i * SectorSize]);
+            }
+            delete [] data;
+            pos += 1 + record->count;
+            journalSeq++;
+            replayed++;
+        }
+    }
+    DEBUG(dbgDisk, "Journal replayed " << replayed << " transactions");
+
+    journalHead = journalTail = pos;
+    journalRecords = 0;
+    WriteJournalHeader();
+    maxPinned = min(min(JournalRecordMax, cacheSize / 2), numSectors - 2);
+    if (maxPinned <= 0) {
+        journalStart = -1;		// no cache to hold transactions
+        this->logAll = FALSE;
+        return;
+    }
+    logMap = new HashTable<int, LogCopy *>(LogCopyKey, LogCopyHash);
+    (new Thread("log cleaner", -1))->Fork((VoidFunctionPtr) LogCleaner,
+                                          (void *) this);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadRecord
+// 	Read the record numbered journalSeq, which should be at "*pos",
+//	or at the start of the log if it did not fit there.  Return its
+//	sectors, in a buffer the caller must free, and leave its
+//	descriptor in "buf" and its sector in "*pos".  Return NULL if it
+//	is in neither place, or was only partly written.
+//----------------------------------------------------------------------
+
+char *
+SynchDisk::ReadRecord(int *pos, char *buf)
+{
+    JournalRecord *record = (JournalRecord *) buf;
+    int logStart = journalStart + 1;
+    int logEnd = journalStart + journalSize;
+
+    for (int at = *pos; ; at = logStart) {
+        if (at + 1 < logEnd) {
+            DiskRead(at, buf);
+            if (JournalRecordValid(record, journalSeq, at, logEnd)) {
+                char *data = new char[record->count * SectorSize];
+
+                DiskRead(at + 1, data, record->count);
+                if (JournalChecksum(data, record->count) == record->checksum) {
+                    *pos = at;
+                    return data;
+                }
+                delete [] data;		// torn by a crash
+            }
+        }
+        if (at == logStart) {
+            return NULL;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::BeginOp/EndOp
+// 	Bracket a file system operation.  Everything the thread writes in
+//	between is committed in the same transaction.  A thread that is
+//	already inside an operation just carries on with it: BeginOp
+//	returns FALSE, and the caller must not call EndOp.  It also
+//	returns FALSE if there is no journal.
+//
+//	At the end of the last operation in progress, the transaction is
+//	committed if it is more than half full, or has been open for
+//	JournalCommitTicks; otherwise later operations join it.
+//----------------------------------------------------------------------
+
+bool
+SynchDisk::BeginOp()
+{
+    if (journalStart == -1 || opThreads->IsInList(kernel->currentThread)) {
+        return FALSE;
+    }
+    opThreads->Append(kernel->currentThread);
+    return TRUE;
+}
+
+void
+SynchDisk::EndOp()
+{
+    opThreads->Remove(kernel->currentThread);
+    if (opThreads->IsEmpty() && numPinned > 0 &&
+        (numPinned > maxPinned / 2 ||
+         kernel->stats->totalTicks - txnStart >= JournalCommitTicks)) {
+        Commit();
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Commit
+// 	Commit the open transaction: append a record with every pinned
+//	sector to the log, with one disk request, and unpin them.  They
+//	stay dirty in the cache, and the log map says where their new
+//	contents are, until the log is cleaned.  If the log has no room
+//	left, it is cleaned first; once it is half full, the cleaner
+//	thread is woken up to clean it in the background.
+//
+//	This normally happens between operations.  An operation that
+//	writes more sectors than a transaction can hold is committed in
+//	pieces, and is not atomic.
+//
+//	The cache lock is held while a record is written, so that nothing
+//	changes in it meanwhile.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Commit()
+{
+    if (journalStart == -1) {
+        return;
+    }
+    lock->Acquire();
+    while (numPinned > 0) {
+        int n = min(numPinned, JournalRecordMax);
+        int pos = LogSpace(1 + n);
+        char *buf;
+        JournalRecord *record;
+        int i, j;
+
+        if (pos == -1) {
+            Clean();			// lets go of the lock, so more
+            continue;			// may have been pinned
+        }
+        buf = new char[(1 + n) * SectorSize];
+        bzero(buf, SectorSize);
+        record = (JournalRecord *) buf;
+        for (i = j = 0; j < n; i++) {
+            if (cache[i].pinned) {
+                ASSERT(!cache[i].busy);
+                record->home[j] = cache[i].sector;
+                bcopy(cache[i].data, &buf[(1 + j) * SectorSize], SectorSize);
+                j++;
+            }
+        }
+        record->magic = JournalMagic;
+        record->seq = journalSeq;
+        record->count = n;
+        record->checksum = JournalChecksum(&buf[SectorSize], n);
+        DiskWrite(pos, buf, 1 + n);
+
+        for (j = 0; j < n; j++) {
+            cache[Lookup(record->home[j])].pinned = FALSE;
+            SetLogCopy(record->home[j], pos + 1 + j);
+        }
+        delete [] buf;
+        if (journalRecords++ == 0) {
+            journalHead = pos;
+        }
+        journalTail = pos + 1 + n;
+        journalSeq++;
+        numPinned -= n;
+        kernel->stats->numJournalCommits++;
+        kernel->stats->numJournalSectors += n;
+    }
+    if (2 * LogUsed() > journalSize) {
+        cleanWanted->Signal(lock);
+    }
+    slotFree->Broadcast(lock);		// unpinned slots can be recycled
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Journaled
+// 	Return TRUE if writes to a run of sectors must be journaled: if
+//	every write is, or the writer is inside an operation, or any of
+//	the sectors is in the log or pinned.  The lock must be held.
+//----------------------------------------------------------------------
+
+bool
+SynchDisk::Journaled(int sectorNumber, int numSectors)
+{
+    if (journalStart == -1) {
+        return FALSE;
+    }
+    if (logAll || opThreads->IsInList(kernel->currentThread)) {
+        return TRUE;
+    }
+    for (int i = 0; i < numSectors; i++) {
+        int slot = Lookup(sectorNumber + i);
+
+        if (IsLogged(sectorNumber + i) ||
+            (slot != -1 && cache[slot].pinned)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Pin
+// 	Add a cache slot just written to the open transaction.  The lock
+//	must be held.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Pin(int slot)
+{
+    if (cache[slot].pinned) {
+        return;
+    }
+    cache[slot].pinned = TRUE;
+    if (numPinned++ == 0) {
+        txnStart = kernel->stats->totalTicks;
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SetLogCopy
+// 	Record that the newest contents of "sectorNumber" are now in log
+//	sector "logSector".  The lock must be held.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::SetLogCopy(int sectorNumber, int logSector)
+{
+    LogCopy *copy;
+
+    if (!logMap->Find(sectorNumber, &copy)) {
+        copy = new LogCopy;
+        copy->sector = sectorNumber;
+        logMap->Insert(copy);
+    }
+    copy->logSector = logSector;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::LogSpace
+// 	Return the sector where a record of "numSectors" sectors can be
+//	appended to the log: the tail, or the start of the log if it
+//	does not fit before the end.  Return -1 if the log is too full.
+//	The lock must be held.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::LogSpace(int numSectors)
+{
+    int logStart = journalStart + 1;
+    int logEnd = journalStart + journalSize;
+
+    if (journalRecords > 0 && journalTail <= journalHead) {
+        // wrapped around: the free space is between tail and head
+        return (journalTail + numSectors <= journalHead) ? journalTail : -1;
+    }
+    if (journalTail + numSectors <= logEnd) {
+        return journalTail;
+    }
+    if (journalRecords == 0 || logStart + numSectors <= journalHead) {
+        return logStart;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::LogUsed
+// 	Return the number of log sectors between the head and the tail.
+//	The lock must be held.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::LogUsed()
+{
+    if (journalRecords == 0) {
+        return 0;
+    }
+    if (journalTail > journalHead) {
+        return journalTail - journalHead;
+    }
+    return journalSize - 1 - (journalHead - journalTail);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Clean
+// 	Write home the newest copy of every sector in the log, and move
+//	the head of the log past the records holding them.  The log is
+//	read in one sweep, and the sectors are written home in increasing
+//	order, neighbours with one request.  If the cleaner thread is at
+//	it already, wait for it to finish first.
+//
+//	The lock must be held.  It is let go while the disk is busy, so
+//	that the file system can carry on, committing to the rest of the
+//	log.  Only once the sectors are home, and the journal header says
+//	so, do they leave the log map; a sector's entry stays if it has
+//	been committed again meanwhile.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Clean()
+{
+    int logStart = journalStart + 1;
+    int logEnd = journalStart + journalSize;
+    int head, end, records, count = 0;
+    LogCopy *copies;
+    char *log, *buf;
+
+    while (cleaning) {
+        logSpace->Wait(lock);
+    }
+    if (journalRecords == 0) {
+        return;
+    }
+    cleaning = TRUE;
+    head = journalHead;
+    end = journalTail;
+    records = journalRecords;
+    copies = new LogCopy[journalSize];
+    for (HashIterator<int, LogCopy *> iter(logMap); !iter.IsDone();
+         iter.Next()) {
+        copies[count++] = *iter.Item();
+    }
     lock->Release();
+
+    log = new char[journalSize * SectorSize];	// by sector - logStart
+    if (end > head) {
+        DiskRead(head, &log[(head - logStart) * SectorSize], end - head);
+    } else {
+        if (logEnd > head) {
+            DiskRead(head, &log[(head - logStart) * SectorSize],
+                     logEnd - head);
+        }
+        if (end > logStart) {
+            DiskRead(logStart, log, end - logStart);
+        }
+    }
+    qsort(copies, count, sizeof(LogCopy), CompareLogCopies);
+    buf = new char[count * SectorSize];
+    for (int i = 0, run; i < count; i += run) {
+        for (run = 1; i + run < count &&
+                      copies[i + run].sector == copies[i].sector + run; run++) {
+        }
+        for (int j = 0; j < run; j++) {
+            bcopy(&log[(copies[i + j].logSector - logStart) * SectorSize],
+                  &buf[j * SectorSize], SectorSize);
+        }
+        DiskWrite(copies[i].sector, buf, run);
+    }
+    delete [] buf;
+    delete [] log;
+
+    lock->Acquire();
+    journalHead = end;
+    journalRecords -= records;
+    WriteJournalHeader();
+    for (int i = 0; i < count; i++) {
+        LogCopy *copy;
+
+        if (logMap->Find(copies[i].sector, &copy) &&
+            copy->logSector == copies[i].logSector) {
+            int slot = Lookup(copies[i].sector);
+
+            delete logMap->Remove(copies[i].sector);
+            if (slot != -1 && !cache[slot].pinned && !cache[slot].busy) {
+                cache[slot].dirty = FALSE;	// same as what went home
+            }
+        }
+    }
+    delete [] copies;
+    kernel->stats->numLogCleanings++;
+    cleaning = FALSE;
+    logSpace->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::RunCleaner
+// 	Body of the log cleaner thread: clean the log whenever more than
+//	half of it is in use.  The thread never finishes; it is asleep
+//	when Nachos halts.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::RunCleaner()
+{
+    lock->Acquire();
+    for (;;) {
+        while (2 * LogUsed() <= journalSize) {
+            cleanWanted->Wait(lock);
+        }
+        Clean();
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteJournalHeader
+// 	Write the journal's first sector, saying where the oldest record
+//	not yet cleaned is, and what number it has.  The lock must be
+//	held, or the journal just opened.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteJournalHeader()
+{
+    char buf[SectorSize];
+    JournalHeader *header = (JournalHeader *) buf;
+
+    bzero(buf, SectorSize);
+    header->magic = JournalMagic;
+    header->seq = journalSeq - journalRecords;
+    header->head = journalHead;
+    header->flags = logAll ? JournalLogAll : 0;
+    header->generation = journalGeneration;
+    DiskWrite(journalStart, buf);
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::CallBack
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler.  Start the next queued request, if any,
+//	and then tell whoever is interested that the request that just
+//	finished is done.
 //----------------------------------------------------------------------
 
 void
 SynchDisk::CallBack()
 { 
-    semaphore->V();
+    DiskRequest *done = current;
+
+    current = NULL;
+    if (!queue->IsEmpty()) {
+        StartRequest(NextRequest());
+    }
+    done->finished = TRUE;
+    if (done->callWhenDone != NULL) {
+        done->callWhenDone->CallBack();
+    }
+    done->done->V();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::DiskRead/DiskWrite
+// 	Send a single request for "numSectors" sectors to the raw disk,
+//	and wait until it is done.  The caller must not hold the lock,
+//	so that other threads can use the cache meanwhile.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::DiskRead(int sectorNumber, char* data, int numSectors)
+{
+    Semaphore done("synch disk request", 0);
+    DiskRequest request = { sectorNumber, numSectors, data, FALSE, &done,
+                            NULL, FALSE, NULL };
+
+    Transfer(&request);
+}
+
+void
+SynchDisk::DiskWrite(int sectorNumber, char* data, int numSectors)
+{
+    Semaphore done("synch disk request", 0);
+    DiskRequest request = { sectorNumber, numSectors, data, TRUE, &done,
+                            NULL, FALSE, NULL };
+
+    numWrites++;
+    Transfer(&request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadHome
+// 	Read "numSectors" sectors from disk, as DiskRead, but take those
+//	whose newest contents are in the log from there.  If any are, the
+//	lock is held throughout, so that the cleaner cannot move them home
+//	and reuse their place in the log meanwhile.  The caller must not
+//	hold the lock.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadHome(int sectorNumber, char* data, int numSectors)
+{
+    bool logged = FALSE;
+
+    if (logMap == NULL) {
+        DiskRead(sectorNumber, data, numSectors);
+        return;
+    }
+    lock->Acquire();
+    for (int i = 0; !logged && i < numSectors; i++) {
+        logged = IsLogged(sectorNumber + i);
+    }
+    if (!logged) {
+        lock->Release();
+        DiskRead(sectorNumber, data, numSectors);
+        return;
+    }
+    DiskRead(sectorNumber, data, numSectors);
+    ReadLogged(sectorNumber, numSectors, data);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadLogged
+// 	Read the sectors of a run whose newest contents are in the log
+//	from there, over the corresponding parts of a buffer holding the
+//	run.  The lock must be held.
+//
+//	"sectorNumber" -- the first sector of the run
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- the contents of the run
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadLogged(int sectorNumber, int numSectors, char* data)
+{
+    for (int i = 0; i < numSectors; i++) {
+        LogCopy *copy;
+
+        if (logMap->Find(sectorNumber + i, &copy)) {
+            DiskRead(copy->logSector, &data[i * SectorSize]);
+            kernel->stats->numLogReads++;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Submit
+// 	Start a request at once if the disk is idle, otherwise queue it.
+//
+//	"request" -- the sectors to transfer
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Submit(DiskRequest *request)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    if (current == NULL) {
+        StartRequest(request);
+    } else {
+        queue->Append(request);
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Transfer
+// 	Submit a request, and wait for the interrupt handler to say it
+//	is done.
+//
+//	"request" -- the sectors to transfer
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Transfer(DiskRequest *request)
+{
+    Submit(request);
+    request->done->P();			// wait for interrupt
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartRequest
+// 	Send a request to the raw disk, and count the tracks the head
+//	has to cross to get to it.  Interrupts must be disabled.
+//
+//	"request" -- the sectors to transfer
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StartRequest(DiskRequest *request)
+{
+    int tracks = request->sector / SectorsPerTrack
+                 - headSector / SectorsPerTrack;
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff && current == NULL);
+    current = request;
+    kernel->stats->diskSeekTracks += (tracks < 0) ? -tracks : tracks;
+    headSector = request->sector + request->numSectors - 1;
+    if (request->writing) {
+        disk->WriteRequest(request->sector, request->data,
+                           request->numSectors);
+    } else {
+        disk->ReadRequest(request->sector, request->data,
+                          request->numSectors);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::NextRequest
+// 	Remove from the queue, and return, the request the scheduling
+//	policy says should be serviced next.  The queue must not be empty.
+//
+//	FCFS takes the oldest request.  SSTF takes the request on the
+//	track nearest the head.  SCAN takes the nearest request in the
+//	direction the head is sweeping, turning around when there is none
+//	left that way.  C-LOOK takes the nearest request at or above the
+//	head, and when there is none, starts over from the lowest request.
+//
+//	Whatever the policy, a request is never moved ahead of an earlier
+//	one it conflicts with (see Blocked), so a read queued after a
+//	write of the same sector sees the new data, and of two writes the
+//	later one lands last.
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::NextRequest()
+{
+    ListIterator<DiskRequest *> iter(queue);
+    DiskRequest *best = NULL;		// best request at or above head
+    DiskRequest *below = NULL;		// best request below the head
+    int headTrack = headSector / SectorsPerTrack;
+
+    if (policy == DiskFCFS) {
+        return queue->RemoveFront();
+    }
+    for (; !iter.IsDone(); iter.Next()) {
+        DiskRequest *request = iter.Item();
+        int track = request->sector / SectorsPerTrack;
+
+        if (Blocked(request)) {
+            continue;
+        }
+        if (policy == DiskSSTF) {
+            if (best == NULL || abs(track - headTrack) <
+                    abs(best->sector / SectorsPerTrack - headTrack)) {
+                best = request;
+            }
+        } else if (request->sector >= headSector) {
+            if (best == NULL || request->sector < best->sector) {
+                best = request;
+            }
+        } else if (below == NULL ||
+                   (policy == DiskCLOOK && request->sector < below->sector) ||
+                   (policy == DiskSCAN && request->sector > below->sector)) {
+            below = request;		// C-LOOK: lowest; SCAN: highest
+        }
+    }
+    if (policy == DiskSCAN) {
+        if (best == NULL) {
+            sweepUp = FALSE;
+        } else if (below == NULL) {
+            sweepUp = TRUE;
+        }
+        if (!sweepUp) {
+            best = below;
+        }
+    } else if (best == NULL) {
+        best = below;
+    }
+    queue->Remove(best);
+    return best;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Blocked
+// 	Return TRUE if a request must wait for one queued before it: one
+//	that touches any of the same sectors, where either of the two
+//	writes.  The request at the front of the queue is never blocked.
+//
+//	"request" -- a request in the queue
+//----------------------------------------------------------------------
+
+bool
+SynchDisk::Blocked(DiskRequest *request)
+{
+    ListIterator<DiskRequest *> iter(queue);
+
+    for (; iter.Item() != request; iter.Next()) {
+        DiskRequest *earlier = iter.Item();
+
+        if ((earlier->writing || request->writing) &&
+                earlier->sector < request->sector + request->numSectors &&
+                request->sector < earlier->sector + earlier->numSectors) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Lookup
+// 	Return the cache slot holding "sectorNumber", or -1 if the sector
+//	is not cached.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::Lookup(int sectorNumber)
+{
+    int slot = hashHeads[sectorNumber % cacheSize];
+
+    while (slot != -1 && cache[slot].sector != sectorNumber) {
+        slot = cache[slot].hashNext;
+    }
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WaitForSlot
+// 	Return the cache slot holding "sectorNumber", or -1 if the sector
+//	is not cached.  If the slot is busy, wait until it is not; the
+//	lock is released while waiting.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::WaitForSlot(int sectorNumber)
+{
+    int slot;
+
+    while ((slot = Lookup(sectorNumber)) != -1 && cache[slot].busy) {
+        slotFree->Wait(lock);
+    }
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::GetSlot
+// 	Take the least recently used slot that is not busy (or pinned by
+//	the journal) and assign it to "sectorNumber".  The contents of
+//	the returned slot are undefined.  A dirty sector whose newest
+//	contents are in the log is just dropped; reads find it there
+//	until the log is cleaned.
+//
+//	If the slot holds another dirty sector, or every slot is busy,
+//	the lock has to be released -- to write the sector back, or to
+//	wait -- and another thread may have cached "sectorNumber" in the
+//	meantime.  Return -1 in that case; the caller should look up the
+//	sector again.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::GetSlot(int sectorNumber)
+{
+    int slot = lruTail;
+    int bucket = sectorNumber % cacheSize;
+
+    while (slot != -1 && (cache[slot].busy || cache[slot].pinned)) {
+        slot = cache[slot].prev;
+    }
+    if (slot == -1) {
+        slotFree->Wait(lock);
+        return -1;
+    }
+    if (cache[slot].sector != -1) {
+        if (cache[slot].dirty && !IsLogged(cache[slot].sector)) {
+            cache[slot].busy = TRUE;
+            lock->Release();
+            DiskWrite(cache[slot].sector, cache[slot].data);
+            lock->Acquire();
+            cache[slot].dirty = FALSE;
+            cache[slot].busy = FALSE;
+            slotFree->Broadcast(lock);
+            return -1;
+        }
+        kernel->stats->numCacheEvictions++;
+        HashRemove(slot);
+    }
+    cache[slot].sector = sectorNumber;
+    cache[slot].dirty = FALSE;
+    cache[slot].pinned = FALSE;
+    cache[slot].hashNext = hashHeads[bucket];
+    hashHeads[bucket] = slot;
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Install
+// 	Add a sector that was just read from disk to the cache.  If some
+//	other thread cached the sector in the meantime, its copy is at
+//	least as new as ours, so hand that one back to the caller instead.
+//
+//	"sectorNumber" -- the sector that was read
+//	"data" -- its contents
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Install(int sectorNumber, char* data)
+{
+    int slot;
+
+    for (;;) {
+        slot = WaitForSlot(sectorNumber);
+        if (slot != -1) {
+            bcopy(cache[slot].data, data, SectorSize);
+            break;
+        }
+        slot = GetSlot(sectorNumber);
+        if (slot != -1) {
+            bcopy(data, cache[slot].data, SectorSize);
+            break;
+        }
+    }
+    Touch(slot);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Touch
+// 	Mark a slot as the most recently used one.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Touch(int slot)
+{
+    if (slot == lruHead) {
+        return;
+    }
+    Unlink(slot);
+    cache[slot].prev = -1;
+    cache[slot].next = lruHead;
+    cache[lruHead].prev = slot;
+    lruHead = slot;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Unlink
+// 	Remove a slot from the LRU list.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Unlink(int slot)
+{
+    if (cache[slot].prev != -1) {
+        cache[cache[slot].prev].next = cache[slot].next;
+    } else {
+        lruHead = cache[slot].next;
+    }
+    if (cache[slot].next != -1) {
+        cache[cache[slot].next].prev = cache[slot].prev;
+    } else {
+        lruTail = cache[slot].prev;
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::HashRemove
+// 	Remove a slot from the hash chain of the sector it caches.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::HashRemove(int slot)
+{
+    int *link = &hashHeads[cache[slot].sector % cacheSize];
+
+    while (*link != slot) {
+        ASSERT(*link != -1);
+        link = &cache[*link].hashNext;
+    }
+    *link = cache[slot].hashNext;
 }
@@ -14,6 +14,127 @@
 #include "disk.h"
 #include "synch.h"
 #include "callback.h"
+#include "hash.h"
+
+// Default number of sectors kept in the sector cache; can be
+// overridden with "-dc <# sectors>" (0 turns the cache off).
+const int DefaultCacheSize = 128;
+
+// The following class defines one slot in the sector cache.  Slots are
+// linked into an LRU list (most recently used at the head) and into a
+// hash chain indexed by sector number.
+
+class CacheEntry {
+  public:
+    int sector;				// disk sector held here, -1 if none
+    bool dirty;				// modified since read from disk?
+    bool busy;				// being read or written by a thread
+					// that has let go of the cache lock
+    int prev, next;			// LRU list links (slot indices)
+    int hashNext;			// next slot in the same hash chain
+    bool pinned;			// written in a transaction not yet
+					// committed to the journal, so it
+					// must stay in the cache
+    char data[SectorSize];		// cached contents of the sector
+};
+
+// The journal is a run of sectors on disk where the sectors written by
+// file system operations are logged before they go to their homes.
+// Its first sector holds a JournalHeader; the rest is a circular log of
+// records, each one descriptor sector (a JournalRecord) and then the
+// new contents of the sectors it lists.  A record never wraps around
+// the end of the log: if it does not fit there, it goes at the start.
+
+const int JournalMagic = 0x4a726e6c;
+const int JournalRecordMax = (SectorSize - 4 * sizeof(int)) / sizeof(int);
+					// most sectors in one record
+const int JournalCommitTicks = 100000;	// commit a transaction at the end
+					// of an operation once it is
+					// this old
+const int JournalLogAll = 0x1;		// header flag: every write is
+					// logged (data journaling)
+
+class JournalHeader {
+  public:
+    int magic;				// JournalMagic
+    int seq;				// sequence number of the oldest
+					// record not yet cleaned
+    int head;				// sector where it should be; the
+					// start of the log if it is not
+    int flags;				// JournalLogAll, if set at format
+    int generation;			// bumped each time the disk is
+					// mounted, so tools can tell it
+					// may have changed
+};
+
+class JournalRecord {
+  public:
+    int magic;				// JournalMagic
+    int seq;				// sequence number of the record
+    int count;				// number of sectors logged
+    unsigned int checksum;		// of their contents, to tell a
+					// record that was not completely
+					// written
+    int home[JournalRecordMax];		// where each of them belongs
+};
+
+// JournalChecksum returns the checksum (FNV-1a) of the sectors logged
+// in a record, so that a record only partly written before a crash is
+// not replayed.  JournalRecordValid says whether the descriptor at log
+// sector "at" is the record numbered "seq", and fits before "logEnd";
+// its sectors must still be checked against its checksum.  Both are
+// shared with the fsck tool, which replays the journal as mount does.
+
+inline unsigned int
+JournalChecksum(char *data, int numSectors)
+{
+    unsigned int sum = 2166136261u;
+
+    for (int i = 0; i < numSectors * SectorSize; i++) {
+        sum = (sum ^ (unsigned char) data[i]) * 16777619u;
+    }
+    return sum;
+}
+
+inline bool
+JournalRecordValid(JournalRecord *record, int seq, int at, int logEnd)
+{
+    return record->magic == JournalMagic && record->seq == seq &&
+           record->count > 0 && record->count <= JournalRecordMax &&
+           at + 1 + record->count <= logEnd;
+}
+
+// The following class records where in the log the last committed
+// contents of a sector are, until the log cleaner writes them home.
+// Together these form an in-memory map, by home sector, of everything
+// in the log that is newer than the disk.
+
+class LogCopy {
+  public:
+    int sector;				// home sector
+    int logSector;			// log sector with its contents
+};
+
+// The following class defines one request waiting for, or being
+// serviced by, the raw disk.  A synchronous request lives on the stack
+// of the thread that made it, which sleeps on "done" until the request
+// completes.  An asynchronous request is allocated by ReadAsync or
+// WriteAsync, and is the handle the caller later passes to Poll and Wait.
+
+class DiskRequest {
+  public:
+    int sector;				// first sector to transfer
+    int numSectors;			// number of consecutive sectors
+    char *data;				// buffer to transfer from/to
+    bool writing;			// write request?
+    Semaphore *done;			// signalled when request completes
+    CallBackObj *callWhenDone;		// also told when it completes,
+					// from the interrupt handler
+    bool finished;			// has the request completed?
+    int *slots;				// for an asynchronous write, the
+					// cache slot of each sector that
+					// it holds busy, or -1
+};
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -25,11 +146,38 @@
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
 // returning.
+//
+// Many threads may have requests outstanding at once.  Requests that
+// arrive while the disk is busy are queued, and each time the disk
+// finishes a request the next one is picked from the queue according
+// to the scheduling policy.
+//
+// Requests can also be made asynchronously: the caller gets a handle
+// back at once, and can carry on working while the disk is busy,
+// checking on the request with Poll and collecting it with Wait.
+//
+// Sectors are kept in a write-back cache: reads of recently used
+// sectors are satisfied from memory, and writes only reach the disk
+// when the sector is evicted or when Flush is called.
+//
+// Once a journal is opened, sectors written inside a file system
+// operation (between BeginOp and EndOp) are pinned in the cache until
+// they have been logged to the journal in a transaction with the rest
+// of the operation.  Several operations are grouped into a transaction.
+// Logged sectors go home when a background thread cleans the log.  A
+// disk formatted for data journaling logs every write, data too.
 
 class SynchDisk : public CallBackObj {
   public:
-    SynchDisk();    		        // Initialize a synchronous disk,
-					// by initializing the raw Disk.
+    SynchDisk(int cacheSize, DiskSchedPolicy policy,
+	      bool mapDisk = FALSE);
+					// Initialize a synchronous disk,
+					// by initializing the raw Disk
+					// (mapped into memory if
+					// "mapDisk").  Cache up to
+					// "cacheSize" sectors, and order
+					// queued requests according to
+					// "policy".
     ~SynchDisk();			// De-allocate the synch disk data
     
     void ReadSector(int sectorNumber, char* data);
@@ -39,17 +187,147 @@ class SynchDisk : public CallBackObj {
     					// Disk::ReadRequest/WriteRequest and
 					// then wait until the request is done.
     void WriteSector(int sectorNumber, char* data);
+
+    void ReadSectors(int sectorNumber, int numSectors, char* data);
+    void WriteSectors(int sectorNumber, int numSectors, char* data);
+					// Read/write a run of "numSectors"
+					// consecutive sectors, using as few
+					// disk requests as possible
+
+    DiskRequest *ReadAsync(int sectorNumber, int numSectors, char* data,
+                           CallBackObj *toCall = NULL);
+    DiskRequest *WriteAsync(int sectorNumber, int numSectors, char* data,
+                            CallBackObj *toCall = NULL);
+					// Start reading/writing a run of
+					// sectors, and return at once with
+					// a handle for the request.  If
+					// "toCall" is given, its CallBack is
+					// invoked when the request is done.
+    bool Poll(DiskRequest *request);	// Has the request completed?
+    void Wait(DiskRequest *request);	// Wait until the request is done,
+					// and free the handle.  Must be
+					// called once for every handle.
+
+    void CopyCached(int sectorNumber, int numSectors, char* data);
+					// Copy the sectors of a run that
+					// are cached over "data"
+    int WriteCount() { return numWrites; }
+					// Number of writes sent to disk, so
+					// callers holding sectors read
+					// earlier can tell if they may
+					// have gone stale
+
+    void Flush();			// Write every dirty cached sector
+					// back to disk
+
+    void OpenJournal(int firstSector, int numSectors, bool format,
+                     bool logAll = FALSE);
+					// Log operations in the journal at
+					// "firstSector", replaying it
+					// first unless "format"; log all
+					// writes if formatted "logAll"
+    bool JournalsData() { return logAll; }
+					// Are all writes logged?
+    bool BeginOp();			// Start a file system operation, whose
+					// writes are committed atomically;
+					// FALSE if already in one
+    void EndOp();			// End an operation begun by BeginOp
+    void Commit();			// Log the writes of the operations so
+					// far, and let them go home
     
     void CallBack();			// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
+    void RunCleaner();			// Body of the log cleaner thread
 
   private:
     Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
+    DiskSchedPolicy policy;		// How to pick the next request
+    List<DiskRequest *> *queue;		// Requests waiting for the disk
+    DiskRequest *current;		// Request the disk is servicing,
+					// NULL if the disk is idle
+    int headSector;			// Last sector of the previous request
+    bool sweepUp;			// Direction of the SCAN elevator
+
+    Lock *lock;		  		// Protects the cache; not held
+					// while waiting for the disk
+    Condition *slotFree;		// Signalled when a busy slot is
+					// no longer busy
+    int numWrites;			// Writes sent to disk so far
+
+    int cacheSize;			// number of slots in the cache
+    CacheEntry *cache;			// the cache slots
+    int *hashHeads;			// first slot of each hash chain
+    int lruHead, lruTail;		// most/least recently used slots
+
+    int journalStart;			// first sector of the journal, -1
+					// if there is none
+    int journalSize;			// # of sectors in the journal
+    int journalHead;			// where the oldest record is
+    int journalTail;			// where the next record goes
+    int journalSeq;			// sequence number of the next record
+    int journalRecords;			// # of records not yet cleaned
+    int journalGeneration;		// mount count kept in the header
+    bool logAll;			// log every write?
+    List<Thread *> *opThreads;		// threads inside an operation
+    int numPinned;			// # of slots pinned
+    int maxPinned;			// most slots a transaction may pin
+    int txnStart;			// when the first of them was pinned
+    HashTable<int, LogCopy *> *logMap;	// sectors whose newest contents
+					// are in the log
+    Condition *cleanWanted;		// the log needs cleaning
+    Condition *logSpace;		// the log has been cleaned
+    bool cleaning;			// is the log being cleaned?
+
+    void DiskRead(int sectorNumber, char* data, int numSectors = 1);
+    void DiskWrite(int sectorNumber, char* data, int numSectors = 1);
+					// Issue one request to the raw disk
+					// and wait for it to complete
+    void ReadHome(int sectorNumber, char* data, int numSectors = 1);
+					// DiskRead, taking sectors whose
+					// newest contents are in the log
+					// from there
+    void ReadLogged(int sectorNumber, int numSectors, char* data);
+					// Copy those sectors of a run that
+					// are in the log over "data"
+    void Submit(DiskRequest *request);	// Start or queue a request
+    void Transfer(DiskRequest *request);// Submit a request and wait for it
+    void StartRequest(DiskRequest *request);
+					// Hand a request to the raw disk
+    DiskRequest *NextRequest();		// Remove the request to service
+					// next from the queue
+    bool Blocked(DiskRequest *request);	// Must it wait for an earlier
+					// request to the same sectors?
+
+    int Lookup(int sectorNumber);	// Slot caching the sector, or -1
+    int WaitForSlot(int sectorNumber);	// Lookup, waiting until the slot
+					// is not busy
+    int GetSlot(int sectorNumber);	// Recycle the LRU slot for the
+					// sector, or write back its old
+					// contents and return -1
+    void Install(int sectorNumber, char* data);
+					// Add a sector just read to the cache
+    void Touch(int slot);		// Move slot to the head of the LRU
+    void Unlink(int slot);		// Remove slot from the LRU list
+    void HashRemove(int slot);		// Remove slot from its hash chain
+
+    bool Journaled(int sectorNumber, int numSectors);
+					// Must writes to these sectors be
+					// logged?
+    void Pin(int slot);			// Add a slot to the transaction
+    bool IsLogged(int sectorNumber) { return logMap != NULL &&
+                                             logMap->IsInTable(sectorNumber); }
+					// Are its newest contents in the log?
+    void SetLogCopy(int sectorNumber, int logSector);
+					// They are now at "logSector"
+    char *ReadRecord(int *pos, char *buf);
+					// Read the next record in the log
+    int LogSpace(int numSectors);	// Where a record of "numSectors"
+					// can go, or -1 if the log is full
+    int LogUsed();			// # of log sectors not yet cleaned
+    void Clean();			// Write home everything logged so
+					// far, and drop it from the log
+    void WriteJournalHeader();		// Record where the log starts
 };
 
 #endif // SYNCHDISK_H
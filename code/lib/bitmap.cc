@@ -2,6 +2,10 @@
 //	Routines to manage a bitmap -- an array of bits each of which
 //	can be either on or off.  Represented as an array of integers.
 //
+//	Searching is done a word at a time: a word that is all ones has
+//	no clear bit to offer, and within a word the lowest clear bit is
+//	found by counting trailing zeroes, rather than bit by bit.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -10,6 +14,22 @@
 #include "debug.h"
 #include "bitmap.h"
 
+// Number of bits in the bitmap SelfTest times allocations from: as
+// many as there are sectors on the Nachos disk.
+const int BenchmarkBits = 1 << 19;
+
+//----------------------------------------------------------------------
+// LowestBit
+// 	Return the number of the lowest bit set in "word", which must not
+//	be zero.
+//----------------------------------------------------------------------
+
+static inline int
+LowestBit(unsigned int word)
+{
+    return __builtin_ctz(word);
+}
+
 //----------------------------------------------------------------------
 // BitMap::BitMap
 // 	Initialize a bitmap with "numItems" bits, so that every bit is clear.
@@ -30,9 +50,8 @@ Bitmap::Bitmap(int numItems)
     for (i = 0; i < numWords; i++) {
 	map[i] = 0;		// initialize map to keep Purify happy
     }
-    for (i = 0; i < numBits; i++) {
-        Clear(i);
-    }
+    numClear = numBits;
+    nextFit = 0;
 }
 
 //----------------------------------------------------------------------
@@ -55,9 +74,14 @@ Bitmap::~Bitmap()
 void
 Bitmap::Mark(int which) 
 { 
+    unsigned int bit = 1u << (which % BitsInWord);
+
     ASSERT(which >= 0 && which < numBits);
 
-    map[which / BitsInWord] |= 1 << (which % BitsInWord);
+    if (!(map[which / BitsInWord] & bit)) {
+	map[which / BitsInWord] |= bit;
+	numClear--;
+    }
 
     ASSERT(Test(which));
 }
@@ -72,9 +96,14 @@ Bitmap::Mark(int which)
 void 
 Bitmap::Clear(int which) 
 {
+    unsigned int bit = 1u << (which % BitsInWord);
+
     ASSERT(which >= 0 && which < numBits);
 
-    map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+    if (map[which / BitsInWord] & bit) {
+	map[which / BitsInWord] &= ~bit;
+	numClear++;
+    }
 
     ASSERT(!Test(which));
 }
@@ -91,51 +120,201 @@ Bitmap::Test(int which) const
 {
     ASSERT(which >= 0 && which < numBits);
     
-    if (map[which / BitsInWord] & (1 << (which % BitsInWord))) {
+    if (map[which / BitsInWord] & (1u << (which % BitsInWord))) {
 	return TRUE;
     } else {
 	return FALSE;
     }
 }
 
+//----------------------------------------------------------------------
+// Bitmap::NextClear
+// 	Return the number of the first clear bit at or after bit "from",
+//	or numBits if there is none.  Words with every bit set are
+//	skipped whole.
+//----------------------------------------------------------------------
+
+int
+Bitmap::NextClear(int from) const
+{
+    int w = from / BitsInWord;
+    unsigned int bits;
+
+    if (from >= numBits) {
+	return numBits;
+    }
+    bits = ~map[w] & (~0u << (from % BitsInWord));
+    while (bits == 0) {
+	if (++w == numWords) {
+	    return numBits;
+	}
+	bits = ~map[w];
+    }
+    // the unused bits past numBits in the last word read as clear
+    return min(w * BitsInWord + LowestBit(bits), numBits);
+}
+
+//----------------------------------------------------------------------
+// Bitmap::NextSet
+// 	Return the number of the first set bit at or after bit "from",
+//	or numBits if there is none.  Words with every bit clear are
+//	skipped whole.
+//----------------------------------------------------------------------
+
+int
+Bitmap::NextSet(int from) const
+{
+    int w = from / BitsInWord;
+    unsigned int bits;
+
+    if (from >= numBits) {
+	return numBits;
+    }
+    bits = map[w] & (~0u << (from % BitsInWord));
+    while (bits == 0) {
+	if (++w == numWords) {
+	    return numBits;
+	}
+	bits = map[w];
+    }
+    return w * BitsInWord + LowestBit(bits);
+}
+
 //----------------------------------------------------------------------
 // Bitmap::FindAndSet
-// 	Return the number of the first bit which is clear.
+// 	Return the number of the first bit which is clear, at or after
+//	bit "start" (going back to bit 0 if there is none past "start").
 //	As a side effect, set the bit (mark it as in use).
 //	(In other words, find and allocate a bit.)
 //
 //	If no bits are clear, return -1.
+//
+//	"start" -- where to begin looking, so that callers can ask for
+//		a bit near one they already have.  If it is left out,
+//		the search goes on from just past the last bit found
+//		("next fit"), instead of rescanning the full part of the
+//		bitmap every time.
 //----------------------------------------------------------------------
 
 int 
-Bitmap::FindAndSet() 
+Bitmap::FindAndSet(int start) 
 {
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    Mark(i);
-	    return i;
+    int i;
+
+    if (start < 0) {
+	start = nextFit;
+    }
+    ASSERT(start <= numBits);
+    if (numClear == 0) {
+	return -1;
+    }
+    i = NextClear(start);
+    if (i == numBits) {
+	i = NextClear(0);
+    }
+    ASSERT(i < numBits);
+    Mark(i);
+    nextFit = i + 1;
+    return i;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindAndSetRange
+// 	Find "n" consecutive clear bits, at or after bit "start" if there
+//	are any there, otherwise from bit 0.  Set them, and return the
+//	number of the first.  A run does not wrap around the end of the
+//	bitmap.
+//
+//	If there is no such run, return -1, leaving the bitmap alone.
+//
+//	"n" -- how many bits are needed
+//	"start" -- where to begin looking; as for FindAndSet
+//----------------------------------------------------------------------
+
+int
+Bitmap::FindAndSetRange(int n, int start)
+{
+    int pos, first, end;
+    bool wrapped = FALSE;
+
+    ASSERT(n > 0);
+    if (start < 0) {
+	start = nextFit;
+    }
+    ASSERT(start <= numBits);
+    if (numClear < n) {
+	return -1;
+    }
+    for (pos = start;;) {
+	first = NextClear(pos);
+	if (first == numBits || (wrapped && first >= start)) {
+	    if (wrapped) {
+		return -1;
+	    }
+	    wrapped = TRUE;
+	    pos = 0;
+	    continue;
+	}
+	end = NextSet(first);
+	if (end - first >= n) {
+	    for (int i = first; i < first + n; i++) {
+		Mark(i);
+	    }
+	    nextFit = first + n;
+	    return first;
 	}
+	pos = end;
     }
-    return -1;
 }
 
 //----------------------------------------------------------------------
-// Bitmap::NumClear
-// 	Return the number of clear bits in the bitmap.
-//	(In other words, how many bits are unallocated?)
+// Bitmap::CountClear
+// 	Count the clear bits all over again.  Needed when the contents
+//	of "map" are replaced wholesale, as when a persistent bitmap is
+//	read from disk.
 //----------------------------------------------------------------------
 
-int 
-Bitmap::NumClear() const
+void
+Bitmap::CountClear()
 {
-    int count = 0;
+    int set = 0;
 
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    count++;
+    for (int i = 0; i < numWords; i++) {
+	set += __builtin_popcount(map[i]);
+    }
+    numClear = numBits - set;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::NumClearIn
+// 	Return the number of clear bits among the "n" bits starting at
+//	bit "first" (or up to the end of the bitmap, if that comes first).
+//	Whole words in the range are counted at once.
+//
+//	"first" -- the first bit to count
+//	"n" -- how many bits to count
+//----------------------------------------------------------------------
+
+int
+Bitmap::NumClearIn(int first, int n) const
+{
+    int last = min(first + n, numBits);
+    int set = 0;
+    int i = first;
+
+    ASSERT(first >= 0 && first <= numBits);
+    while (i < last) {
+	if (i % BitsInWord == 0 && i + BitsInWord <= last) {
+	    set += __builtin_popcount(map[i / BitsInWord]);
+	    i += BitsInWord;
+	} else {
+	    if (Test(i)) {
+		set++;
+	    }
+	    i++;
 	}
     }
-    return count;
+    return (last - first) - set;
 }
 
 //----------------------------------------------------------------------
@@ -161,7 +340,8 @@ Bitmap::Print() const
 
 //----------------------------------------------------------------------
 // Bitmap::SelfTest
-// 	Test whether this module is working.
+// 	Test whether this module is working, then time how fast bits can
+//	be allocated from a bitmap as big as the Nachos disk's free map.
 //----------------------------------------------------------------------
 
 void
@@ -169,7 +349,7 @@ Bitmap::SelfTest()
 {
     int i;
     
-    ASSERT(numBits >= BitsInWord);	// bitmap must be big enough
+    ASSERT(numBits >= 2 * BitsInWord + 10);	// bitmap must be big enough
 
     ASSERT(NumClear() == numBits);	// bitmap must be empty
     ASSERT(FindAndSet() == 0);
@@ -184,8 +364,67 @@ Bitmap::SelfTest()
     for (i = 0; i < numBits; i++) {
         Mark(i);
     }
+    ASSERT(NumClear() == 0);
     ASSERT(FindAndSet() == -1);		// bitmap should be full!
     for (i = 0; i < numBits; i++) {
         Clear(i);
     }
+    ASSERT(NumClear() == numBits);
+
+    // searches with no start pick up where the last one left off
+    ASSERT(FindAndSet(0) == 0);
+    ASSERT(FindAndSet() == 1);
+    Clear(0);
+    ASSERT(FindAndSet() == 2);
+    ASSERT(FindAndSet(0) == 0);
+    ASSERT(FindAndSet(numBits - 1) == numBits - 1);
+    ASSERT(FindAndSet() == 3);		// wrapped around
+
+    // runs skip holes that are too small
+    Mark(2 * BitsInWord);
+    ASSERT(FindAndSetRange(10, 0) == 4);
+    ASSERT(FindAndSetRange(2 * BitsInWord - 13, 0) == 2 * BitsInWord + 1);
+    ASSERT(NumClear() == numBits - 6 - 10 - (2 * BitsInWord - 13));
+    ASSERT(FindAndSetRange(numBits, 0) == -1);
+
+    // counts over part of the map, word-aligned or not
+    ASSERT(NumClearIn(0, BitsInWord) == BitsInWord - 14);
+    ASSERT(NumClearIn(13, 2) == 1);
+    ASSERT(NumClearIn(0, numBits) == NumClear());
+    for (i = 0; i < numBits; i++) {
+        Clear(i);
+    }
+    ASSERT(NumClear() == numBits);
+
+    // time allocation on a bitmap the size of the disk's free map:
+    // first filling it in order, then refilling scattered holes
+    // searching from bit 0 each time
+    Bitmap *big = new Bitmap(BenchmarkBits);
+    int holes = 0;
+    double begin, nextFitTime, firstFitTime;
+
+    begin = HostSeconds();
+    for (i = 0; i < BenchmarkBits; i++) {
+	big->FindAndSet();
+    }
+    nextFitTime = HostSeconds() - begin;
+    ASSERT(big->NumClear() == 0);
+
+    for (i = 0; i < BenchmarkBits; i += 1 + RandomNumber() % 128) {
+	big->Clear(i);
+	holes++;
+    }
+    begin = HostSeconds();
+    for (i = 0; i < holes; i++) {
+	big->FindAndSet(0);
+    }
+    firstFitTime = HostSeconds() - begin;
+    ASSERT(big->NumClear() == 0);
+    delete big;
+
+    cout << "Bitmap: " << BenchmarkBits << " bits, "
+	 << (int)(BenchmarkBits / max(nextFitTime, 1e-6))
+	 << " next-fit allocations/sec, "
+	 << (int)(holes / max(firstFitTime, 1e-6))
+	 << " first-fit allocations/sec\n";
 }
@@ -4,6 +4,9 @@
 //
 //	Represented as an array of unsigned integers, on which we do
 //	modulo arithmetic to find the bit we are interested in.
+//	Searches go a word at a time, skipping words that are all set
+//	(or all clear), and the number of clear bits is kept up to date
+//	as bits change.
 //
 //	The bitmap can be parameterized with with the number of bits being 
 //	managed.
@@ -34,15 +37,25 @@ class Bitmap {
   public:
     Bitmap(int numItems);	// Initialize a bitmap, with "numItems" bits
 				// initially, all bits are cleared.
-    ~Bitmap();			// De-allocate bitmap
+    virtual ~Bitmap();		// De-allocate bitmap
     
-    void Mark(int which);   	// Set the "nth" bit
-    void Clear(int which);  	// Clear the "nth" bit
+    virtual void Mark(int which);	// Set the "nth" bit
+    virtual void Clear(int which);	// Clear the "nth" bit
     bool Test(int which) const;	// Is the "nth" bit set?
-    int FindAndSet();         // Return the # of a clear bit, and as a side
-				// effect, set the bit. 
+    int FindAndSet(int start = -1);
+				// Return the # of a clear bit, and as a side
+				// effect, set the bit.  The search begins
+				// at bit "start" (by default, just past
+				// the last bit found), wrapping around.
 				// If no bits are clear, return -1.
-    int NumClear() const;	// Return the number of clear bits
+    int FindAndSetRange(int n, int start = -1);
+				// Same, for "n" consecutive clear bits;
+				// return the # of the first
+    int NumClear() const { return numClear; }
+				// Return the number of clear bits
+    int NumClearIn(int first, int n) const;
+				// Same, among bits "first" to
+				// "first"+"n"-1
 
     void Print() const;		// Print contents of bitmap
     void SelfTest();		// Test whether bitmap is working
@@ -54,6 +67,16 @@ class Bitmap {
 				//  multiple of the number of bits in
 				//  a word)
     unsigned int *map;		// bit storage
+    int numClear;		// number of clear bits
+    int nextFit;		// where a search with no "start"
+				// begins: just past the last bit found
+
+    void CountClear();		// Recompute numClear from scratch, after
+				// "map" was changed behind our back
+    int NextClear(int from) const;
+				// # of the first clear bit at or after
+				// "from", or numBits if there is none
+    int NextSet(int from) const;// Same, for a set bit
 };
 
 #endif // BITMAP_H
@@ -51,9 +51,9 @@ extern "C" {
 #include <signal.h>
 #include <sys/types.h>
 
-#ifndef NO_MPROT 
 #include <sys/mman.h>
-#endif
+#include <sys/stat.h>
+#include <dirent.h>
 
 // UNIX routines called by procedures in this file 
 
@@ -149,6 +149,22 @@ UDelay(unsigned int useconds)
 
 }
 
+//----------------------------------------------------------------------
+// HostSeconds
+// 	Return the host's wall clock time, in seconds.  Only differences
+//	between two calls mean anything.  Used to time self tests; the
+//	simulation itself runs on simulated time (see stats.h).
+//----------------------------------------------------------------------
+
+double
+HostSeconds()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
@@ -420,6 +436,106 @@ Unlink(char *name)
     return unlink(name);
 }
 
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "nBytes" of an open file into memory, shared, so
+//	that storing into the memory changes the file.  Return the address
+//	of the mapping.  Abort on error.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int nBytes)
+{
+    void *addr = mmap(NULL, nBytes, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ASSERT(addr != MAP_FAILED);
+    return (char *) addr;
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Write a mapping made by MapFile back to its file, and remove it.
+//	Abort on error.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *addr, int nBytes)
+{
+    int retVal = msync(addr, nBytes, MS_SYNC);
+    ASSERT(retVal == 0);
+    retVal = munmap(addr, nBytes);
+    ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// IsDirectory
+// 	Return TRUE if "name" is a directory.
+//----------------------------------------------------------------------
+
+bool
+IsDirectory(char *name)
+{
+    struct stat info;
+
+    return stat(name, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+//----------------------------------------------------------------------
+// IsSymbolicLink
+// 	Return TRUE if "name" is itself a symbolic link (which is not
+//	followed).
+//----------------------------------------------------------------------
+
+bool
+IsSymbolicLink(char *name)
+{
+    struct stat info;
+
+    return lstat(name, &info) == 0 && S_ISLNK(info.st_mode);
+}
+
+//----------------------------------------------------------------------
+// OpenDirectory
+// 	Open a directory for reading its entries.  Return a handle to
+//	pass to ReadDirectory and CloseDirectory, or NULL on error.
+//----------------------------------------------------------------------
+
+void *
+OpenDirectory(char *name)
+{
+    return (void *) opendir(name);
+}
+
+//----------------------------------------------------------------------
+// ReadDirectory
+// 	Return the name of the next entry of an open directory, other
+//	than "." and "..", or NULL if there are no more.  The name is
+//	good until the next call.
+//----------------------------------------------------------------------
+
+char *
+ReadDirectory(void *dir)
+{
+    struct dirent *entry;
+
+    do {
+        entry = readdir((DIR *) dir);
+    } while (entry != NULL && (strcmp(entry->d_name, ".") == 0 ||
+                               strcmp(entry->d_name, "..") == 0));
+    return (entry != NULL) ? entry->d_name : NULL;
+}
+
+//----------------------------------------------------------------------
+// CloseDirectory
+// 	Close a directory opened by OpenDirectory.
+//----------------------------------------------------------------------
+
+void
+CloseDirectory(void *dir)
+{
+    closedir((DIR *) dir);
+}
+
 //----------------------------------------------------------------------
 // OpenSocket
 // 	Open an interprocess communication (IPC) connection.  For now, 
@@ -24,6 +24,8 @@ extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
 extern void UDelay(unsigned int usec);// rcgood - to avoid spinners.
+extern double HostSeconds();	// Host wall clock time, for timing
+				// self tests; not simulated time
 
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(void (*cleanup)(int));
@@ -52,6 +54,15 @@ extern void Lseek(int fd, int offset, int whence);
 extern int Tell(int fd);
 extern int Close(int fd);
 extern bool Unlink(char *name);
+extern char *MapFile(int fd, int nBytes);
+extern void UnmapFile(char *addr, int nBytes);
+
+// Directory operations, for copying a UNIX directory tree into Nachos
+extern bool IsDirectory(char *name);
+extern bool IsSymbolicLink(char *name);
+extern void *OpenDirectory(char *name);
+extern char *ReadDirectory(void *dir);
+extern void CloseDirectory(void *dir);
 
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
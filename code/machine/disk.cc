@@ -34,9 +34,11 @@ const int DiskSize = (MagicSize + (NumSectors * SectorSize));
 // 	ok to treat it as Nachos disk storage.
 //
 //	"toCall" -- object to call when disk read/write request completes
+//	"mapped" -- map the UNIX file into memory, rather than reading and
+//		writing it a request at a time
 //----------------------------------------------------------------------
 
-Disk::Disk(CallBackObj *toCall) {
+Disk::Disk(CallBackObj *toCall, bool mapped) {
     int magicNum;
     int tmp = 0;
 
@@ -59,16 +61,21 @@ Disk::Disk(CallBackObj *toCall) {
         Lseek(fileno, DiskSize - sizeof(int), 0);
         WriteFile(fileno, (char *)&tmp, sizeof(int));
     }
+    image = mapped ? MapFile(fileno, DiskSize) : NULL;
     active = FALSE;
 }
 
 //----------------------------------------------------------------------
 // Disk::~Disk()
 // 	Clean up disk simulation, by closing the UNIX file representing the
-//	disk.
+//	disk.  If the file is mapped into memory, it is written back first.
 //----------------------------------------------------------------------
 
-Disk::~Disk() { Close(fileno); }
+Disk::~Disk() {
+    if (image != NULL)
+        UnmapFile(image, DiskSize);
+    Close(fileno);
+}
 
 //----------------------------------------------------------------------
 // Disk::PrintSector()
@@ -90,7 +97,7 @@ static void PrintSector(bool writing, int sector, char *data) {
 
 //----------------------------------------------------------------------
 // Disk::ReadRequest/WriteRequest
-// 	Simulate a request to read/write a single disk sector
+// 	Simulate a request to read/write a run of consecutive disk sectors
 //	   Do the read/write immediately to the UNIX file
 //	   Set up an interrupt handler to be called later,
 //	      that will notify the caller when the simulator says
@@ -99,43 +106,68 @@ static void PrintSector(bool writing, int sector, char *data) {
 //	Note that a disk only allows an entire sector to be read/written,
 //	not part of a sector.
 //
-//	"sectorNumber" -- the disk sector to read/write
+//	If the UNIX file is mapped into memory, the sectors are just
+//	copied to or from it.
+//
+//	"sectorNumber" -- the first disk sector to read/write
 //	"data" -- the bytes to be written, the buffer to hold the incoming bytes
+//	"numSectors" -- the number of sectors to transfer
 //----------------------------------------------------------------------
 
-void Disk::ReadRequest(int sectorNumber, char *data) {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+void Disk::ReadRequest(int sectorNumber, char *data, int numSectors) {
+    int endSector = sectorNumber + numSectors - 1;
+    int ticks = ComputeLatency(sectorNumber, FALSE) +
+                StreamTime(sectorNumber, numSectors);
 
     ASSERT(!active); // only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
-
-    DEBUG(dbgDisk, "Reading from sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
+    ASSERT((sectorNumber >= 0) && (numSectors > 0) &&
+           (endSector < NumSectors));
+
+    DEBUG(dbgDisk, "Reading from sector " << sectorNumber << " count "
+                                          << numSectors);
+    if (image != NULL) {
+        bcopy(image + SectorSize * sectorNumber + MagicSize, data,
+              SectorSize * numSectors);
+    } else {
+        Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
+        Read(fileno, data, SectorSize * numSectors);
+    }
     if (debug->IsEnabled('d'))
-        PrintSector(FALSE, sectorNumber, data);
+        for (int i = 0; i < numSectors; i++)
+            PrintSector(FALSE, sectorNumber + i, data + i * SectorSize);
 
     active = TRUE;
     UpdateLast(sectorNumber);
+    UpdateLast(endSector);
     kernel->stats->numDiskReads++;
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
 
-void Disk::WriteRequest(int sectorNumber, char *data) {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+void Disk::WriteRequest(int sectorNumber, char *data, int numSectors) {
+    int endSector = sectorNumber + numSectors - 1;
+    int ticks = ComputeLatency(sectorNumber, TRUE) +
+                StreamTime(sectorNumber, numSectors);
 
     ASSERT(!active);
-    //std::cout << sectorNumber << '\n';
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
-
-    DEBUG(dbgDisk, "Writing to sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
+    ASSERT((sectorNumber >= 0) && (numSectors > 0) &&
+           (endSector < NumSectors));
+
+    DEBUG(dbgDisk, "Writing to sector " << sectorNumber << " count "
+                                        << numSectors);
+    if (image != NULL) {
+        bcopy(data, image + SectorSize * sectorNumber + MagicSize,
+              SectorSize * numSectors);
+    } else {
+        Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
+        WriteFile(fileno, data, SectorSize * numSectors);
+    }
     if (debug->IsEnabled('d'))
-        PrintSector(TRUE, sectorNumber, data);
+        for (int i = 0; i < numSectors; i++)
+            PrintSector(TRUE, sectorNumber + i, data + i * SectorSize);
 
     active = TRUE;
     UpdateLast(sectorNumber);
+    UpdateLast(endSector);
     kernel->stats->numDiskWrites++;
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
@@ -176,6 +208,21 @@ int Disk::TimeToSeek(int newSector, int *rotation) {
     return seek;
 }
 
+//----------------------------------------------------------------------
+// Disk::StreamTime()
+// 	Return how long it takes, once the first sector of a request has
+//	been transferred, to stream the remaining sectors past the head:
+//	one RotationTime per sector, plus a one-track seek every time the
+//	run moves onto the next track.
+//----------------------------------------------------------------------
+
+int Disk::StreamTime(int firstSector, int numSectors) {
+    int endSector = firstSector + numSectors - 1;
+    int tracks = endSector / SectorsPerTrack - firstSector / SectorsPerTrack;
+
+    return (numSectors - 1) * RotationTime + tracks * SeekTime;
+}
+
 //----------------------------------------------------------------------
 // Disk::ModuloDiff()
 // 	Return number of sectors of rotational delay between target sector
@@ -46,6 +46,16 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// A single request may transfer a run of consecutive sectors.  It pays
+// for one seek and rotational delay to reach the first sector, and then
+// streams the rest past the head at one sector per RotationTime, plus
+// a one-track seek whenever the run crosses onto the next track.
+//
+// The UNIX file can optionally be mapped into memory, so that sectors
+// are copied in and out of it without a system call per request.  This
+// only makes the simulation run faster on the host; the simulated time
+// a request takes is the same either way.
 
 const int SectorSize = 128;		// number of bytes per disk sector
 const int SectorsPerTrack  = 32;	// number of sectors per disk track 
@@ -53,19 +63,34 @@ const int NumTracks = 16384;		// number of tracks per disk 64*1024*1024/128/32
 const int NumSectors = (SectorsPerTrack * NumTracks);
 					// total # of sectors per disk
 
+// Policies for ordering the requests queued for the disk (see
+// SynchDisk).  The disk itself services whatever it is handed.
+
+enum DiskSchedPolicy {
+    DiskFCFS,				// in arrival order
+    DiskSSTF,				// nearest track first
+    DiskSCAN,				// elevator, sweeping up and down
+    DiskCLOOK				// elevator, sweeping up only
+};
+
 class Disk : public CallBackObj {
   public:
-    Disk(CallBackObj *toCall);          // Create a simulated disk.  
+    Disk(CallBackObj *toCall, bool mapped = FALSE);
+					// Create a simulated disk.  
 					// Invoke toCall->CallBack() 
 					// when each request completes.
+					// If "mapped", map the UNIX file
+					// into memory.
     ~Disk();				// Deallocate the disk.
     
-    void ReadRequest(int sectorNumber, char* data);
-    					// Read/write an single disk sector.
+    void ReadRequest(int sectorNumber, char* data, int numSectors = 1);
+    					// Read/write "numSectors" consecutive
+					// disk sectors starting at 
+					// "sectorNumber".
 					// These routines send a request to 
     					// the disk and return immediately.
     					// Only one request allowed at a time!
-    void WriteRequest(int sectorNumber, char* data);
+    void WriteRequest(int sectorNumber, char* data, int numSectors = 1);
 
     void CallBack();			// Invoked when disk request 
 					// finishes. In turn calls, callWhenDone.
@@ -78,6 +103,8 @@ class Disk : public CallBackObj {
   private:
     int fileno;				// UNIX file number for simulated disk 
     char diskname[32];			// name of simulated disk's file
+    char *image;			// the file mapped into memory,
+					// or NULL if it isn't
     CallBackObj *callWhenDone;		// Invoke when any disk request finishes
     bool active;     			// Is a disk operation in progress?
     int lastSector;			// The previous disk request 
@@ -85,6 +112,10 @@ class Disk : public CallBackObj {
 					// being loaded
 
     int TimeToSeek(int newSector, int *rotate); // time to get to the new track
+    int StreamTime(int firstSector, int numSectors);
+					// time to transfer the sectors after
+					// the first one of a multi-sector
+					// request
     int ModuloDiff(int to, int from);        // # sectors between to and from
     void UpdateLast(int newSector);
 };
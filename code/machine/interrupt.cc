@@ -23,6 +23,8 @@
 #include "copyright.h"
 #include "interrupt.h"
 #include "main.h"
+#include "synchdisk.h"
+#include "filehdr.h"
 
 // String definitions for debugging messages
 
@@ -232,19 +234,24 @@ Interrupt::Idle()
 //----------------------------------------------------------------------
 // Interrupt::Halt
 // 	Shut down Nachos cleanly, printing out performance statistics.
+//	Headers of files still open, then dirty sectors in the disk
+//	cache, are written back first, while the kernel is still intact.
 //----------------------------------------------------------------------
 void
 Interrupt::Halt()
 {
+#ifndef FILESYS_STUB
+	kernel->inodeTable->Flush();
+#endif
+	kernel->synchDisk->Flush();
+
 	// MP4 mod tag
 	/*
     cout << "Machine halting!\n\n";
     cout << "This is halt\n";
     kernel->stats->Print();
 	*/
-	delete debug;
-	
-    delete kernel;	// Never returns.
+    delete kernel;	// Never returns; deletes debug last.
 }
 
 #ifdef FILESYS_STUB
@@ -19,7 +19,12 @@
 Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
-    numDiskReads = numDiskWrites = 0;
+    numDiskReads = numDiskWrites = diskSeekTracks = 0;
+    diskPolicy = "FCFS";
+    numCacheHits = numCacheMisses = numCacheEvictions = 0;
+    numReadAheadSectors = numReadAheadHits = 0;
+    numJournalCommits = numJournalSectors = numLogCleanings = 0;
+    numLogReads = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
 }
@@ -37,6 +42,26 @@ Statistics::Print()
 		cout << ", system " << systemTicks << ", user " << userTicks <<"\n";
     cout << "Disk I/O: reads " << numDiskReads;
 		cout << ", writes " << numDiskWrites << "\n";
+    if (numDiskReads + numDiskWrites > 0) {
+	cout << "Disk seeks: " << diskPolicy << ", tracks " << diskSeekTracks;
+	cout << ", average " << (double) diskSeekTracks /
+				(numDiskReads + numDiskWrites) << "\n";
+    }
+    cout << "Disk cache: hits " << numCacheHits;
+		cout << ", misses " << numCacheMisses;
+		cout << ", evictions " << numCacheEvictions << "\n";
+    if (numReadAheadSectors > 0) {
+	cout << "Read-ahead: sectors " << numReadAheadSectors;
+	cout << ", hits " << numReadAheadHits << ", hit rate "
+	     << 100.0 * numReadAheadHits / numReadAheadSectors << "%\n";
+    }
+    if (numJournalCommits > 0) {
+	cout << "Journal: commits " << numJournalCommits;
+	cout << ", sectors " << numJournalSectors << ", per commit "
+	     << (double) numJournalSectors / numJournalCommits;
+	cout << ", cleanings " << numLogCleanings;
+	cout << ", sectors read from the log " << numLogReads << "\n";
+    }
 		cout << "Console I/O: reads " << numConsoleCharsRead;
     cout << ", writes " << numConsoleCharsWritten << "\n";
     cout << "Paging: faults " << numPageFaults << "\n";
@@ -30,6 +30,18 @@ class Statistics {
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int diskSeekTracks;		// tracks crossed to reach disk requests
+    char *diskPolicy;		// how disk requests were scheduled
+    int numCacheHits;		// sector requests served by the disk cache
+    int numCacheMisses;		// sector requests that missed the cache
+    int numCacheEvictions;	// sectors evicted from the disk cache
+    int numReadAheadSectors;	// sectors read ahead of sequential readers
+    int numReadAheadHits;	// of those, sectors a reader asked for
+    int numJournalCommits;	// records committed to the journal
+    int numJournalSectors;	// sectors logged by them
+    int numLogCleanings;	// times the log was cleaned
+    int numLogReads;		// sectors read from the log, as they
+				// had not gone home yet
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
@@ -0,0 +1,9 @@
+cd ../build.linux
+echo "Rebuild Nachos"
+make clean
+make 
+
+cd ../test
+../build.linux/nachos -f
+../build.linux/nachos -bd /big 10000 | grep Benchmark
+../build.linux/nachos -l /big | tail -3
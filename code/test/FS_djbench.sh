@@ -0,0 +1,11 @@
+
+cd ../build.linux
+echo "Rebuild Nachos"
+make clean
+make 
+
+cd ../test
+../build.linux/nachos -f
+../build.linux/nachos -bw /rand 2000 | grep Benchmark
+../build.linux/nachos -f -dj
+../build.linux/nachos -bw /rand 2000 | grep Benchmark
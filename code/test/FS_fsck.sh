@@ -0,0 +1,15 @@
+cd ../build.linux
+echo "Rebuild Nachos"
+make clean
+make
+make fsck
+
+cd ../test
+../build.linux/nachos -f
+../build.linux/nachos -mkdir /t0
+../build.linux/nachos -cp num_100.txt /t0/f1
+../build.linux/nachos -cp num_1000.txt /t0/f2
+../build.linux/fsck -f DISK_0
+../build.linux/nachos -r /t0/f1
+../build.linux/fsck DISK_0
+../build.linux/fsck DISK_0
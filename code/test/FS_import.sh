@@ -0,0 +1,17 @@
+cd ../build.linux
+echo "Rebuild Nachos"
+make clean
+make
+
+cd ../test
+rm -rf imp
+mkdir -p imp/sub/deeper
+cp num_100.txt imp/a
+cp num_1000.txt imp/sub/b
+cp num_100.txt imp/sub/deeper/c
+../build.linux/nachos -f
+../build.linux/nachos -cp num_1000000.txt /big
+../build.linux/nachos -cpr imp /imp
+../build.linux/nachos -lr /
+../build.linux/nachos -p /imp/sub/deeper/c
+rm -rf imp
@@ -19,6 +19,7 @@
 #include "synchconsole.h"
 #include "filesys.h"
 #include "openfile.h"
+#include "filehdr.h"
 
 //----------------------------------------------------------------------
 // Kernel::Kernel
@@ -31,8 +32,12 @@ Kernel::Kernel(int argc, char **argv) {
     debugUserProg = FALSE;
     consoleIn = NULL;  // default is stdin
     consoleOut = NULL; // default is stdout
+    diskCacheSize = DefaultCacheSize;
+    diskSched = DiskCLOOK;
+    diskMapped = FALSE;
 #ifndef FILESYS_STUB
     formatFlag = FALSE;
+    journalData = FALSE;
 #endif
     reliability = 1; // network reliability, default is 1.0
     hostName = 0;    // machine id, also UNIX socket name
@@ -64,7 +69,28 @@ Kernel::Kernel(int argc, char **argv) {
 #ifndef FILESYS_STUB
         } else if (strcmp(argv[i], "-f") == 0) {
             formatFlag = TRUE;
+        } else if (strcmp(argv[i], "-dj") == 0) {
+            journalData = TRUE;
 #endif
+        } else if (strcmp(argv[i], "-dc") == 0) {
+            ASSERT(i + 1 < argc); // next argument is int
+            diskCacheSize = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-ds") == 0) {
+            ASSERT(i + 1 < argc); // next argument is a policy name
+            if (strcmp(argv[i + 1], "fcfs") == 0) {
+                diskSched = DiskFCFS;
+            } else if (strcmp(argv[i + 1], "sstf") == 0) {
+                diskSched = DiskSSTF;
+            } else if (strcmp(argv[i + 1], "scan") == 0) {
+                diskSched = DiskSCAN;
+            } else {
+                ASSERT(strcmp(argv[i + 1], "clook") == 0);
+                diskSched = DiskCLOOK;
+            }
+            i++;
+        } else if (strcmp(argv[i], "-dm") == 0) {
+            diskMapped = TRUE;
         } else if (strcmp(argv[i], "-n") == 0) {
             ASSERT(i + 1 < argc); // next argument is float
             reliability = atof(argv[i + 1]);
@@ -79,8 +105,12 @@ Kernel::Kernel(int argc, char **argv) {
             cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut]\n";
 #ifndef FILESYS_STUB
             cout << "Partial usage: nachos [-nf]\n";
+            cout << "Partial usage: nachos [-f -dj]\n";
 #endif
             cout << "Partial usage: nachos [-n #] [-m #]\n";
+            cout << "Partial usage: nachos [-dc #cachedSectors]\n";
+            cout << "Partial usage: nachos [-ds fcfs|sstf|scan|clook]\n";
+            cout << "Partial usage: nachos [-dm]\n";
         }
     }
 }
@@ -107,11 +137,12 @@ void Kernel::Initialize() {
     machine = new Machine(debugUserProg);
     synchConsoleIn = new SynchConsoleInput(consoleIn);    // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
-    synchDisk = new SynchDisk();                          //
+    synchDisk = new SynchDisk(diskCacheSize, diskSched, diskMapped);
 #ifdef FILESYS_STUB
     fileSystem = new FileSystem();
 #else
-    fileSystem = new FileSystem(formatFlag);
+    inodeTable = new InodeTable();  // before any file is opened
+    fileSystem = new FileSystem(formatFlag, journalData);
 #endif // FILESYS_STUB
 
     // MP4 mod tag
@@ -142,6 +173,13 @@ void Kernel::PrepareToEnd() {
 //----------------------------------------------------------------------
 
 Kernel::~Kernel() {
+    // the file system closes its files and flushes the disk cache
+    // through locks, so it goes before the interrupt and scheduler
+    delete fileSystem;
+#ifndef FILESYS_STUB
+    delete inodeTable;
+#endif
+    delete synchDisk;
     delete stats;
     delete interrupt;
     delete scheduler;
@@ -149,8 +187,7 @@ Kernel::~Kernel() {
     delete machine;
     delete synchConsoleIn;
     delete synchConsoleOut;
-    delete synchDisk;
-    delete fileSystem;
+    delete debug;
 
     // Mp4 mod tag
     /*
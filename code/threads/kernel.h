@@ -19,12 +19,14 @@
 #include "filesys.h"
 #include "machine.h"
 #include "openfile.h"
+#include "disk.h"
 
 class PostOfficeInput;
 class PostOfficeOutput;
 class SynchConsoleInput;
 class SynchConsoleOutput;
 class SynchDisk;
+class InodeTable;
 
 
 
@@ -72,6 +74,9 @@ class Kernel {
     SynchConsoleInput *synchConsoleIn;
     SynchConsoleOutput *synchConsoleOut;
     SynchDisk *synchDisk;
+#ifndef FILESYS_STUB
+    InodeTable *inodeTable;     // in-core headers of open files
+#endif
     FileSystem *fileSystem;     
     PostOfficeInput *postOfficeIn;
     PostOfficeOutput *postOfficeOut;
@@ -89,8 +94,12 @@ class Kernel {
     double reliability;         // likelihood messages are dropped
     char *consoleIn;            // file to read console input from
     char *consoleOut;           // file to send console output to
+    int diskCacheSize;          // # of sectors cached by synchDisk
+    DiskSchedPolicy diskSched;  // order of queued disk requests
+    bool diskMapped;            // map the disk's UNIX file into memory
 #ifndef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
+    bool journalData;         // ...and journal file data too
 #endif
 };
 
@@ -4,10 +4,11 @@
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
 //              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
-//              -f -cp <unix file> <nachos file>
+//              -f -cp <unix file> <nachos file> -cpr <unix dir> <nachos dir>
 //              -p <nachos file> -r <nachos file> -l -D
-//              -n <network reliability> -m <machine id>
-//              -z -K -C -N
+//              -n <network reliability> -m <machine id> -dc <#sectors>
+//              -ds <fcfs|sstf|scan|clook> -dm -bd <nachos dir> <#files>
+//              -dj -bw <nachos file> <#writes> -z -K -C -N
 //
 //    -d causes certain debugging messages to be printed (see debug.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
@@ -18,17 +19,28 @@
 //    -co specify file for console output (stdout is the default)
 //    -n sets the network reliability
 //    -m sets this machine's host id (needed for the network)
+//    -dc sets the number of sectors held in the disk cache (0 disables it)
+//    -ds sets the order queued disk requests are serviced in (default clook)
+//    -dm maps the disk's UNIX file into memory; faster on the host, same
+//        simulated timing
 //    -K run a simple self test of kernel threads and synchronization
 //    -C run an interactive console test
 //    -N run a two-machine network test (see Kernel::NetworkTest)
 //
 //    Filesystem-related flags:
 //    -f forces the Nachos disk to be formatted
+//    -dj with -f, formats it for data journaling: every write, file data
+//        too, is appended to the log, and goes home when it is cleaned
 //    -cp copies a file from UNIX to Nachos
+//    -cpr copies a UNIX directory, and everything under it, to Nachos
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system 
+//    -bd creates a number of files in one directory, and reports the
+//        simulated time each create took
+//    -bw overwrites a number of randomly chosen sectors of a file, and
+//        reports the simulated time each write took
 //
 //  Note: the file system flags are not used if the stub filesystem
 //        is being used
@@ -43,7 +55,9 @@
 
 #include "main.h"
 #include "filesys.h"
+#include "directory.h"
 #include "openfile.h"
+#include "synchdisk.h"
 #include "sysdep.h"
 
 // global variables
@@ -70,14 +84,49 @@ Cleanup(int x)
 //-------------------------------------------------------------------
 static const int TransferSize = 128;
 
+//-------------------------------------------------------------------
+// Number of bytes "Copy" writes to the Nachos file at a time: a whole
+// number of sectors, so that each write goes to disk as a few
+// multi-sector requests, with no sector read back to be merged
+//-------------------------------------------------------------------
+static const int CopyChunkSize = 8 * SectorsPerTrack * SectorSize;
+
+//-------------------------------------------------------------------
+// Size of the file made by the random-write benchmark (-bw)
+//-------------------------------------------------------------------
+static const int BenchFileSize = 512 * 1024;
+
 
 #ifndef FILESYS_STUB
+//----------------------------------------------------------------------
+// ReadFull
+//      Read up to "size" bytes from the UNIX file "fd", stopping short
+//	only at the end of the file.  Return the number of bytes read.
+//----------------------------------------------------------------------
+
+static int
+ReadFull(int fd, char *buffer, int size)
+{
+    int done = 0, amountRead;
+
+    while (done < size &&
+           (amountRead = ReadPartial(fd, buffer + done, size - done)) > 0)
+        done += amountRead;
+    return done;
+}
+
 //----------------------------------------------------------------------
 // Copy
-//      Copy the contents of the UNIX file "from" to the Nachos file "to"
+//      Copy the contents of the UNIX file "from" to the Nachos file "to".
+//	Return TRUE if it worked.
+//
+//	The Nachos file is created at its full length, so its sectors are
+//	allocated at once, in as few runs as possible, right after its
+//	header.  The data is then streamed in CopyChunkSize pieces, each
+//	written with one call.
 //----------------------------------------------------------------------
 
-static void
+static bool
 Copy(char *from, char *to)
 {
     int fd;
@@ -88,7 +137,7 @@ Copy(char *from, char *to)
 // Open UNIX file
     if ((fd = OpenForReadWrite(from,FALSE)) < 0) {       
         printf("Copy: couldn't open input file %s\n", from);
-        return;
+        return FALSE;
     }
 
 // Figure out length of UNIX file
@@ -101,27 +150,92 @@ Copy(char *from, char *to)
     if (!kernel->fileSystem->Create(to, fileLength, FALSE)) {   // Create Nachos file
         printf("Copy: couldn't create output file %s\n", to);
         Close(fd);
-        return;
+        return FALSE;
     }
     pair<OpenFile*,OpenFileId> openFileInfo = kernel->fileSystem->Open(to);
     openFile = openFileInfo.first;
     ASSERT(openFile != NULL);   
 	
-// Copy the data in TransferSize chunks
-    buffer = new char[TransferSize];
-    while ((amountRead=ReadPartial(fd, buffer, sizeof(char)*TransferSize)) > 0)
-        openFile->Write(buffer, amountRead);    
+// Copy the data in CopyChunkSize chunks
+    buffer = new char[CopyChunkSize];
+    while ((amountRead = ReadFull(fd, buffer, CopyChunkSize)) > 0)
+        openFile->Write(buffer, amountRead);
     delete [] buffer;
 	
 // Close the UNIX and the Nachos files
-	//delete openFileInfo;
-	cout<<"Close"<<'\n';
     delete openFile;
-	kernel->fileSystem->fileDescriptorTable[openFileInfo.second] = NULL;
-	kernel->fileSystem->openedNum--;
-	cout << "openedNum = " << kernel->fileSystem->openedNum << '\n';
-	
+    kernel->fileSystem->fileDescriptorTable[openFileInfo.second] = NULL;
+    kernel->fileSystem->openedNum--;
+    DEBUG(dbgFile, "Copied " << from << ", openedNum = "
+                   << kernel->fileSystem->openedNum);
     Close(fd);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// CopyTree
+//      Copy the UNIX directory "from", and everything under it, into
+//	the Nachos directory "to", made first if it does not exist.
+//	Names too long for a Nachos directory are skipped, and so are
+//	symbolic links, which could lead back up the tree and make the
+//	copy go on forever.  Return the number of files copied.
+//----------------------------------------------------------------------
+
+static int
+CopyTree(char *from, char *to)
+{
+    void *dir = OpenDirectory(from);
+    char *name, *unixPath, *nachosPath;
+    int copied = 0;
+
+    if (dir == NULL) {
+        printf("Copy: couldn't open input directory %s\n", from);
+        return 0;
+    }
+    if (kernel->fileSystem->DirectoryExists(to)) {
+        cout << "Copy: using existing directory " << to << "\n";
+    } else {
+        char *parent = new char[strlen(to) + 2];
+        char *slash;
+        bool made;
+
+        // Create would make a missing parent in the wrong place
+        strcpy(parent, to);
+        if ((slash = strrchr(parent, '/')) != NULL)
+            slash[1] = '\0';
+        else
+            strcpy(parent, "/");
+        made = kernel->fileSystem->DirectoryExists(parent) &&
+               kernel->fileSystem->Create(to, 0, TRUE);
+        delete [] parent;
+        if (!made) {
+            printf("Copy: couldn't create output directory %s\n", to);
+            CloseDirectory(dir);
+            return 0;
+        }
+    }
+
+    while ((name = ReadDirectory(dir)) != NULL) {
+        if (strlen(name) > FileNameMaxLen) {
+            printf("Copy: skipping %s/%s, name too long\n", from, name);
+            continue;
+        }
+        unixPath = new char[strlen(from) + strlen(name) + 2];
+        nachosPath = new char[strlen(to) + strlen(name) + 2];
+        sprintf(unixPath, "%s/%s", from, name);
+        sprintf(nachosPath, "%s%s%s", to,
+                (to[strlen(to) - 1] == '/') ? "" : "/", name);
+        if (IsSymbolicLink(unixPath))
+            printf("Copy: skipping %s, a symbolic link\n", unixPath);
+        else if (IsDirectory(unixPath))
+            copied += CopyTree(unixPath, nachosPath);
+        else if (Copy(unixPath, nachosPath))
+            copied++;
+        delete [] unixPath;
+        delete [] nachosPath;
+    }
+    CloseDirectory(dir);
+    return copied;
 }
 
 #endif // FILESYS_STUB
@@ -173,6 +287,92 @@ CreateDirectory(char *name)
         cout << "Create: unable to create directory " << name << "\n";    
 }
 
+//----------------------------------------------------------------------
+// DirectoryBenchmark
+//      Create "count" empty files in the directory "dir" (made first if
+//	it does not exist), and report the average number of ticks each
+//	create took.  Measures how directory operations scale as a
+//	directory fills up.
+//----------------------------------------------------------------------
+static void
+DirectoryBenchmark(char *dir, int count)
+{
+    char path[500];
+    int failed = 0;
+    int start;
+
+    strcpy(path, dir);
+    if (kernel->fileSystem->Create(path, 0, TRUE) == FALSE)
+        cout << "Benchmark: using existing directory " << dir << "\n";
+
+    start = kernel->stats->totalTicks;
+    for (int i = 0; i < count; i++) {
+        sprintf(path, "%s/f%d", dir, i);
+        if (kernel->fileSystem->Create(path, 0, FALSE) == FALSE)
+            failed++;
+    }
+    if (count > 0)
+        cout << "Benchmark: created " << count - failed << " of " << count
+             << " files in " << dir << ", "
+             << (kernel->stats->totalTicks - start) / count
+             << " ticks per create\n";
+}
+
+//----------------------------------------------------------------------
+// WriteBenchmark
+//      Overwrite "count" randomly chosen sectors of the file "name", one
+//	sector per write, and report the average number of ticks each
+//	write took, including the time to get them all to disk at the
+//	end.  The file is made first, BenchFileSize bytes long, if it does
+//	not exist, and every sector of it is written and flushed before
+//	the clock starts.  Run on a disk formatted with
+//	-f, and on one formatted with -f -dj, to compare journaling only
+//	the metadata with journaling the data too.
+//----------------------------------------------------------------------
+static void
+WriteBenchmark(char *name, int count)
+{
+    pair<OpenFile*,OpenFileId> openFileInfo;
+    OpenFile *openFile;
+    char *buffer = new char[SectorsPerTrack * SectorSize];
+    int blocks, start;
+
+    if (kernel->fileSystem->Create(name, BenchFileSize, FALSE) == FALSE)
+        cout << "Benchmark: using existing file " << name << "\n";
+    openFileInfo = kernel->fileSystem->Open(name);
+    openFile = openFileInfo.first;
+    ASSERT(openFile != NULL);
+
+    // Create only sets the length: write every sector once, so that
+    // none of the timed writes has a gap to zero-fill first
+    bzero(buffer, SectorsPerTrack * SectorSize);
+    blocks = openFile->Length() / SectorSize;
+    for (int off = 0; off < blocks * SectorSize;
+         off += SectorsPerTrack * SectorSize)
+        openFile->WriteAt(buffer, min(SectorsPerTrack * SectorSize,
+                                      blocks * SectorSize - off), off);
+    kernel->synchDisk->Flush();		// start with nothing to write back
+
+    start = kernel->stats->totalTicks;
+    for (int i = 0; i < count; i++) {
+        memset(buffer, 'a' + i % 26, SectorSize);
+        openFile->WriteAt(buffer, SectorSize,
+                          (RandomNumber() % blocks) * SectorSize);
+    }
+    kernel->synchDisk->Flush();
+    if (count > 0)
+        cout << "Benchmark: " << count << " random writes to " << name
+             << (kernel->synchDisk->JournalsData() ? " (data journaled)"
+                                                   : " (in place)")
+             << ", " << (kernel->stats->totalTicks - start) / count
+             << " ticks per write\n";
+
+    delete openFile;
+    kernel->fileSystem->fileDescriptorTable[openFileInfo.second] = NULL;
+    kernel->fileSystem->openedNum--;
+    delete [] buffer;
+}
+
 //----------------------------------------------------------------------
 // main
 // 	Bootstrap the operating system kernel.  
@@ -199,6 +399,7 @@ main(int argc, char **argv)
 #ifndef FILESYS_STUB
     char *copyUnixFileName = NULL;    // UNIX file to be copied into Nachos
     char *copyNachosFileName = NULL;  // name of copied file in Nachos
+    bool copyTreeFlag = false;        // -cpr: copy a whole directory
     char *printFileName = NULL; 
     char *removeFileName = NULL;
     bool dirListFlag = false;
@@ -209,6 +410,10 @@ main(int argc, char **argv)
 	bool mkdirFlag = false;
 	bool recursiveListFlag = false;
 	bool recursiveRemoveFlag = false;
+	char *benchDirectoryName = NULL;  // directory for -bd
+	int benchFileCount = 0;
+	char *benchFileName = NULL;       // file for -bw
+	int benchWriteCount = 0;
 #endif //FILESYS_STUB
 
     // some command line arguments are handled here.
@@ -244,6 +449,13 @@ main(int argc, char **argv)
 	    copyNachosFileName = argv[i + 2];
 	    i += 2;
 	}
+	else if (strcmp(argv[i], "-cpr") == 0) {
+	    ASSERT(i + 2 < argc);
+	    copyUnixFileName = argv[i + 1];
+	    copyNachosFileName = argv[i + 2];
+	    copyTreeFlag = true;
+	    i += 2;
+	}
 	else if (strcmp(argv[i], "-p") == 0) {
 	    ASSERT(i + 1 < argc);
 	    printFileName = argv[i + 1];
@@ -287,6 +499,18 @@ main(int argc, char **argv)
 	else if (strcmp(argv[i], "-D") == 0) {
 	    dumpFlag = true;
 	}
+	else if (strcmp(argv[i], "-bd") == 0) {
+	    ASSERT(i + 2 < argc);
+	    benchDirectoryName = argv[i + 1];
+	    benchFileCount = atoi(argv[i + 2]);
+	    i += 2;
+	}
+	else if (strcmp(argv[i], "-bw") == 0) {
+	    ASSERT(i + 2 < argc);
+	    benchFileName = argv[i + 1];
+	    benchWriteCount = atoi(argv[i + 2]);
+	    i += 2;
+	}
 
 #endif //FILESYS_STUB
 	else if (strcmp(argv[i], "-u") == 0) {
@@ -295,8 +519,11 @@ main(int argc, char **argv)
 	    cout << "Partial usage: nachos [-K] [-C] [-N]\n";
 #ifndef FILESYS_STUB
             cout << "Partial usage: nachos [-cp UnixFile NachosFile]\n";
+            cout << "Partial usage: nachos [-cpr UnixDir NachosDir]\n";
             cout << "Partial usage: nachos [-p fileName] [-r fileName]\n";
             cout << "Partial usage: nachos [-l] [-D]\n";
+            cout << "Partial usage: nachos [-bd dirName numFiles]\n";
+            cout << "Partial usage: nachos [-bw fileName numWrites]\n";
 #endif //FILESYS_STUB
 	}
 
@@ -328,7 +555,12 @@ main(int argc, char **argv)
 		kernel->fileSystem->Remove(recursiveRemoveFlag,removeFileName);
     }
     if (copyUnixFileName != NULL && copyNachosFileName != NULL) {
-		Copy(copyUnixFileName,copyNachosFileName);
+		if (copyTreeFlag)
+		    cout << "Copied " << CopyTree(copyUnixFileName,
+		                                  copyNachosFileName)
+		         << " files\n";
+		else
+		    Copy(copyUnixFileName,copyNachosFileName);
     }
     if (dumpFlag) {
 		kernel->fileSystem->Print();
@@ -344,6 +576,12 @@ main(int argc, char **argv)
     if (printFileName != NULL) {
       Print(printFileName);
     }
+    if (benchDirectoryName != NULL) {
+      DirectoryBenchmark(benchDirectoryName, benchFileCount);
+    }
+    if (benchFileName != NULL) {
+      WriteBenchmark(benchFileName, benchWriteCount);
+    }
 #endif // FILESYS_STUB
 
     // finally, run an initial user program if requested to do so